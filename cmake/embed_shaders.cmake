@@ -0,0 +1,66 @@
+# turns each shader under SOURCE_DIR into a minified string in a generated header (OUTPUT), so that the app doesn't
+# need a virtual filesystem to load them
+#   cmake -DSOURCE_DIR=<dir> -DOUTPUT=<header> -P embed_shaders.cmake
+
+get_filename_component(SOURCE_DIR ${SOURCE_DIR} ABSOLUTE)
+file(GLOB shader_files RELATIVE ${SOURCE_DIR} ${SOURCE_DIR}/*.vert ${SOURCE_DIR}/*.frag)
+list(SORT shader_files)
+
+set(entries "")
+foreach(shader_file ${shader_files})
+  file(READ ${SOURCE_DIR}/${shader_file} text)
+
+  # comments and surplus whitespace go
+  string(REGEX REPLACE "/\\*([^*]|\\*+[^*/])*\\*+/" " " text "${text}")
+  string(REGEX REPLACE "//[^\n]*" "" text "${text}")
+  string(REGEX REPLACE "[ \t\r]+" " " text "${text}")
+  string(REGEX REPLACE " ?\n ?" "\n" text "${text}")
+
+  # spaces around operators and punctuation can go too, except in preprocessor lines (where "#define f (x)" and
+  # "#define f(x)" differ), so those are set aside first
+  set(directives "")
+  set(index 0)
+  string(REGEX MATCHALL "(^|\n)#[^\n]*" matches "${text}")
+  foreach(match ${matches})
+    string(REGEX REPLACE "^\n" "" match "${match}")
+    list(APPEND directives "${match}")
+    string(REPLACE "${match}" "@DIRECTIVE${index}@" text "${text}")
+    math(EXPR index "${index} + 1")
+  endforeach()
+  string(REGEX REPLACE " ?([*/%=<>!&|^,;:?(){}.]) ?" "\\1" text "${text}")
+
+  # ...taking care not to turn "a - -b" into a decrement
+  string(REGEX REPLACE "([^-+]) ([-+])" "\\1\\2" text "${text}")
+  string(REGEX REPLACE "([-+]) ([^-+])" "\\1\\2" text "${text}")
+
+  # lines only need breaking where two words would otherwise run together, or around directives
+  string(REGEX REPLACE "([A-Za-z0-9_])\n([A-Za-z0-9_])" "\\1 \\2" text "${text}")
+  string(REGEX REPLACE "([-+])\n([-+])" "\\1 \\2" text "${text}")
+  string(REGEX REPLACE "\n(@DIRECTIVE)" "@NEWLINE@\\1" text "${text}")
+  string(REGEX REPLACE "(@DIRECTIVE[0-9]+@)\n" "\\1@NEWLINE@" text "${text}")
+  string(REPLACE "\n" "" text "${text}")
+  string(REPLACE "@NEWLINE@" "\n" text "${text}")
+  set(index 0)
+  foreach(directive ${directives})
+    string(REPLACE "@DIRECTIVE${index}@" "${directive}" text "${text}")
+    math(EXPR index "${index} + 1")
+  endforeach()
+  string(STRIP "${text}" text)
+
+  string(APPEND entries "  {\"${shader_file}\", R\"glsl(${text})glsl\"},\n")
+endforeach()
+
+set(header "// generated from the shaders in rsrc by cmake/embed_shaders.cmake; don't edit\n")
+string(APPEND header "#ifndef SHADER_SOURCES_H\n#define SHADER_SOURCES_H\n\n")
+string(APPEND header "struct shader_source {\n  const char* name;\n  const char* text;\n};\n\n")
+string(APPEND header "constexpr shader_source kShaderSources[] {\n${entries}};\n\n")
+string(APPEND header "#endif // SHADER_SOURCES_H\n")
+
+# only touch the header if it's changed, so that editing a comment doesn't rebuild the app
+if (EXISTS ${OUTPUT})
+  file(READ ${OUTPUT} existing)
+  if (existing STREQUAL header)
+    return()
+  endif()
+endif()
+file(WRITE ${OUTPUT} "${header}")
@@ -1,40 +1,184 @@
 #ifndef APP_H
 #define APP_H
 
+#include <cstdint>
 #include <memory>
-#include <GLES2/gl2.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <GLES3/gl3.h>
 
-constexpr float kAspect = 9.0f / 16.0f;
+#include "render_commands.hpp"
+#include "sim_frame.hpp"
 
 void reset_blocks ();
+
+// takes a block off the wall, bursting it into particles
 void clear_block (int row, int col);
 
-void play_launch (int ball);
-void play_bounce (int ball);
-void play_loss (int ball);
+// alpha is the fraction of a simulation step elapsed since the frame's step
+void draw_frame (const sim_frame& frame, float alpha);
 
+// a program built from one of the embedded shader sources (named after its file under rsrc); it starts linking on
+// construction, and mustn't be used until poll_link has returned true.  on WebGL 2 its quad's attribute setup lives in
+// a vertex array, and the uniforms shared by the whole frame come from the frame's uniform buffer
 class shader_program {
 public:
-  shader_program (const char* fragment_filename);
+  shader_program (const char* fragment_name);
+  shader_program (GLuint vertex_shader, const char* fragment_name);
   ~shader_program ();
 
+  // returns true once the program has linked, gathering its attribute and uniform locations the first time
+  bool poll_link ();
+
+  void use () const;
+
+  GLint get_attrib_location (const char* name) const;
+
   void set_uniform (const char* name, int value) const;
   void set_uniform (const char* name, float value) const;
+  void set_uniform (const char* name, float x, float y) const;
 
   void draw_quad (GLfloat x, GLfloat y, GLfloat w, GLfloat h) const;
 
 private:
+  // an active uniform's location, along with the last value uploaded to it
+  struct uniform {
+    GLint location;
+    std::uint32_t value[9];
+    bool uploaded = false;
+  };
+
+  // the fragment shader's name, which also labels the program's draws in the profiler
+  const char* name_;
   GLuint program_;
   GLuint fragment_shader_;
+  bool linked_ = false;
   GLint vertex_location_;
-  GLint matrix_location_;
-  GLint aspect_location_;
-  GLint time_location_;
+  GLuint vertex_array_ = 0;
+
+  // gathered when the program is linked, so we never have to ask GL for a location again
+  mutable std::unordered_map<std::string, uniform> uniforms_;
+  uniform* matrix_uniform_;
+  uniform* aspect_uniform_;
+  uniform* time_uniform_;
+
+  uniform* find_uniform (const char* name) const;
+
+  // makes the program current and returns true if the value differs from the last one uploaded to the uniform
+  bool update_uniform (uniform* uniform, const void* value, std::size_t size) const;
+};
+
+// an offscreen color target for things that are expensive to draw but rarely change: draw into it between begin and
+// end, then composite its texture
+class render_layer {
+public:
+  // the filter applies when the layer is drawn at a different size from its own
+  explicit render_layer (GLint filter = GL_NEAREST);
+  ~render_layer ();
+
+  // (re)allocates the target if the size has changed, returning true if it did (leaving the contents undefined)
+  bool set_size (int width, int height);
+
+  void begin () const;
+  void end () const;
+
+  GLuint get_texture () const { return texture_; }
+
+private:
+  GLuint framebuffer_;
+  GLuint texture_;
+  int width_ = 0;
+  int height_ = 0;
+};
+
+// collects sprites (quads drawn with a program using sprite.vert) over a frame and draws them in a single call, using
+// instanced arrays where available (set up once in a vertex array on WebGL 2) and a packed buffer of six vertices per
+// sprite otherwise
+class sprite_batch {
+public:
+  sprite_batch (const shader_program& program, bool instanced);
+  ~sprite_batch ();
+
+  void add (GLfloat x, GLfloat y, GLfloat w, GLfloat h);
+
+  void flush ();
+
+private:
+  const shader_program& program_;
+  bool instanced_;
+  GLuint buffer_;
+  GLsizeiptr buffer_capacity_ = 0;
+  GLint vertex_location_;
+  GLint sprite_location_;
+  GLuint vertex_array_ = 0;
+  std::vector<GLfloat> data_;
+  GLsizei count_ = 0;
+
+  void set_up_attributes ();
+};
+
+// block-breaking bursts animated entirely on the GPU: each burst is a single record (where, when and in what colour)
+// in a ring buffer, and one draw moves every particle of every burst in the vertex shader, from its burst's record
+// and the time.  the CPU only writes records, so its work goes with the bursts rather than the particles.  with
+// instanced arrays each burst is an instance; without, the record is repeated in each of the burst's vertices
+class particle_system {
+public:
+  particle_system (const shader_program& program, bool instanced);
+  ~particle_system ();
+
+  // starts a burst at the given position (in field coordinates) and time (in seconds), overwriting the oldest
+  void spawn (GLfloat x, GLfloat y, const unsigned char* rgb, GLfloat time);
+
+  // returns true if a burst might still be going
+  bool is_live (GLfloat time) const;
+
+  // uploads the records written since the last draw, in a single call, then draws every burst
+  void draw (GLfloat time);
+
+private:
+  const shader_program& program_;
+  bool instanced_;
+  GLuint corner_buffer_ = 0;
+  GLuint record_buffer_;
+  GLint vertex_location_;
+  GLint burst_location_;
+  GLint color_location_;
+  GLuint vertex_array_ = 0;
+
+  // each particle's quad corners, and the records as they're laid out in the buffer
+  std::vector<GLfloat> corners_;
+  std::vector<GLfloat> records_;
+  int next_slot_ = 0;
+  int dirty_min_slot_;
+  int dirty_max_slot_ = -1;
+  GLfloat last_spawn_time_;
+
+  int get_slot_size () const;
+  void write_record (int slot, const GLfloat* record);
+  void set_up_attributes ();
+};
+
+// draws commands with the programs below, each pass into its own target: block uploads go to the block texture,
+// sprites go through a batch per program, flushed when the program changes, and everything else is a quad of its own
+class gl_render_backend : public render_backend {
+public:
+  // where the frame's own passes go: the layer that's scaled up to the canvas, or the canvas itself (null)
+  void set_frame_layer (const render_layer* layer) { frame_layer_ = layer; }
+
+  void submit (const render_command* commands, std::size_t count) override;
+
+private:
+  const render_layer* frame_layer_ = nullptr;
+
+  void begin_pass (render_command::pass_type pass);
 };
 
 extern std::unique_ptr<shader_program> backdrop_program;
 extern std::unique_ptr<shader_program> paddle_program;
 extern std::unique_ptr<shader_program> ball_program;
 extern std::unique_ptr<shader_program> blocks_program;
+extern std::unique_ptr<shader_program> blit_program;
+extern std::unique_ptr<shader_program> particle_program;
 
 #endif // APP_H
\ No newline at end of file
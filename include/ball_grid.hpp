@@ -0,0 +1,59 @@
+#ifndef BALL_GRID_H
+#define BALL_GRID_H
+
+#include <vector>
+
+#include "ball_pool.hpp"
+
+// two balls close enough to touch, lower index first
+struct ball_pair {
+  int a;
+  int b;
+};
+
+// a uniform grid for finding the balls close enough to touch without testing every pair.  it's rebuilt from scratch
+// each step: a counting sort buckets the free balls by cell into flat arrays (indices and positions in cell order),
+// so that each cell's balls are contiguous and so are those of a cell and its right-hand neighbour, or of three
+// neighbours in a row.  with cells as large as the contact distance, a ball only has to be tested against its own
+// cell and its neighbours, which comes to a handful of contiguous spans
+class ball_grid {
+public:
+  // up to this many balls, sorting them into cells costs more than testing every pair, so they're simply listed
+  static constexpr int kMaxUnsorted = 8;
+
+  // covers [-half_width, half_width] by [-half_height, half_height]; balls outside go in the nearest edge cell, which
+  // costs them some extra tests but never misses a pair
+  ball_grid (float cell_size, float half_width, float half_height);
+
+  // buckets the balls not attached to a paddle
+  void build (const ball_pool& balls);
+
+  // finds the pairs of bucketed balls whose centers are closer than distance (which mustn't exceed the cell size),
+  // in an order that depends only on their positions and indices; returns the number of pairs tested
+  long find_pairs (float distance, std::vector<ball_pair>& pairs) const;
+
+private:
+  float half_width_;
+  float half_height_;
+  float inverse_cell_size_;
+  int cols_;
+  int rows_;
+  bool unsorted_ = true;
+
+  // where each cell's balls start in the arrays below, with the total at the end
+  std::vector<int> cell_starts_;
+
+  // the balls in cell order: their cells, their indices in the pool and their positions
+  std::vector<int> cells_;
+  std::vector<int> indices_;
+  std::vector<float> x_;
+  std::vector<float> y_;
+
+  // scratch space for the sort: each ball's cell (-1 if it's left out), then each cell's next free slot
+  std::vector<int> ball_cells_;
+  std::vector<int> cursors_;
+
+  int get_cell (float x, float y) const;
+};
+
+#endif // BALL_GRID_H
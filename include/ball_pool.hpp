@@ -0,0 +1,66 @@
+#ifndef BALL_POOL_H
+#define BALL_POOL_H
+
+#include <cstdint>
+#include <vector>
+
+constexpr std::uint32_t kBallAttached = 1 << 0;
+constexpr std::uint32_t kBallPlayerOwned = 1 << 1;
+
+// the geometry a free ball may collide with: side walls at +/-max_x, paddle faces at +/-max_y and a band of blocks
+// between min_block_y and max_block_y
+struct ball_bounds {
+  float max_x;
+  float max_y;
+  float min_block_y;
+  float max_block_y;
+};
+
+// what a ball's swept circle came near in the broad phase; the narrow phase needn't test a ball against anything its
+// straight path didn't come near, unless something turns it aside first
+constexpr std::uint32_t kNearWall = 1 << 0;
+constexpr std::uint32_t kNearPaddle = 1 << 1;
+constexpr std::uint32_t kNearBlocks = 1 << 2;
+
+struct ball_candidate {
+  int index;
+  std::uint32_t near;
+};
+
+// structure-of-arrays ball storage, so that the broad per-step tests run several balls per instruction; the arrays
+// are padded out to a multiple of the SIMD width
+struct ball_pool {
+  std::vector<float> x, y;
+  std::vector<float> previous_x, previous_y;
+  std::vector<float> vx, vy;
+  std::vector<std::uint32_t> flags;
+
+  // the computer opponents' cached predictions of where each ball will reach their paddle, valid while the stamp
+  // matches the game's current prediction epoch (zero meaning none)
+  std::vector<float> predicted_x;
+  std::vector<std::uint32_t> prediction_stamps;
+
+  int size () const { return size_; }
+
+  void reserve (int capacity);
+
+  // returns the index of the new ball
+  int add (float x, float y, float vx, float vy, std::uint32_t flags);
+
+  // moves the last ball into the removed one's place
+  void remove (int index);
+
+  void clear ();
+
+  // saves the current positions as previous positions and advances every free ball whose swept circle stays within
+  // bounds; the rest (attached balls and those needing collision handling) are written to candidates in ascending
+  // order of index, with what each came near
+  void integrate (float dt, float radius, const ball_bounds& bounds, std::vector<ball_candidate>& candidates);
+
+private:
+  int size_ = 0;
+
+  void resize (int padded_size);
+};
+
+#endif // BALL_POOL_H
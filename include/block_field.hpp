@@ -0,0 +1,67 @@
+#ifndef BLOCK_FIELD_H
+#define BLOCK_FIELD_H
+
+#include <cstdint>
+#include <vector>
+
+// the blocks still standing, kept as a two-level bitmap: each row is a run of 64-bit words with a bit per block, and
+// each row has a summary word with a bit per nonempty word; on top of that, a bit per nonempty row.  queries walk
+// the set bits with ctz rather than testing blocks one at a time, so empty stretches cost next to nothing
+class block_field {
+public:
+  static constexpr int kWordBits = 64;
+
+  // each row's summary is a single word, which caps the width (the game's own limit, kMaxFieldCols, lies within it)
+  static constexpr int kMaxCols = kWordBits * kWordBits;
+
+  // fills the field with blocks
+  void reset (int rows, int cols);
+
+  int get_rows () const { return rows_; }
+  int get_cols () const { return cols_; }
+  int get_block_count () const { return block_count_; }
+
+  bool test (int row, int col) const {
+    return words_[row * words_per_row_ + col / kWordBits] >> (col % kWordBits) & 1;
+  }
+
+  void clear (int row, int col);
+
+  // the first and last rows with any blocks (first > last if there are none)
+  int get_first_row () const;
+  int get_last_row () const;
+
+  bool row_empty (int row) const { return summaries_[row] == 0; }
+
+  // calls fn(col) for each block in the row between min_col and max_col inclusive (which must lie within the field)
+  template<typename F>
+  void for_each_in_row (int row, int min_col, int max_col, F fn) const {
+    auto summary = summaries_[row];
+    if (summary == 0) return;
+    auto first_word = min_col / kWordBits, last_word = max_col / kWordBits;
+    summary &= word_range_mask(first_word, last_word);
+    auto row_words = &words_[row * words_per_row_];
+    for (; summary != 0; summary &= summary - 1) {
+      auto word_index = __builtin_ctzll(summary);
+      auto word = row_words[word_index];
+      if (word_index == first_word) word &= ~0ull << (min_col % kWordBits);
+      if (word_index == last_word) word &= ~0ull >> (kWordBits - 1 - max_col % kWordBits);
+      for (; word != 0; word &= word - 1) fn(word_index * kWordBits + __builtin_ctzll(word));
+    }
+  }
+
+private:
+  int rows_ = 0;
+  int cols_ = 0;
+  int words_per_row_ = 0;
+  int block_count_ = 0;
+  std::vector<std::uint64_t> words_;
+  std::vector<std::uint64_t> summaries_;
+  std::vector<std::uint64_t> row_summaries_;
+
+  static std::uint64_t word_range_mask (int first, int last) {
+    return (~0ull << first) & (~0ull >> (kWordBits - 1 - last));
+  }
+};
+
+#endif // BLOCK_FIELD_H
@@ -0,0 +1,29 @@
+#ifndef FNV_HASH_H
+#define FNV_HASH_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// 64-bit FNV-1a, for fingerprinting whatever a deterministic run produces (game states, draw commands, observations)
+// so that two runs can be checked against each other
+class fnv_hasher {
+public:
+  void add (const void* data, std::size_t size) {
+    auto bytes = static_cast<const unsigned char*>(data);
+    for (std::size_t i = 0; i < size; ++i) hash_ = (hash_ ^ bytes[i]) * 0x100000001b3ull;
+  }
+
+  template<typename T>
+  void add (const T& value) { add(&value, sizeof(value)); }
+
+  template<typename T>
+  void add (const std::vector<T>& values, int count) { add(values.data(), count * sizeof(T)); }
+
+  std::uint64_t get () const { return hash_; }
+
+private:
+  std::uint64_t hash_ = 0xcbf29ce484222325ull;
+};
+
+#endif // FNV_HASH_H
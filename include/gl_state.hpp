@@ -0,0 +1,86 @@
+#ifndef GL_STATE_H
+#define GL_STATE_H
+
+#include <GLES3/gl3.h>
+
+#include "profiler.hpp"
+
+// shadows the GL binding state so that calls which wouldn't change anything can be skipped; on WebGL each call
+// crosses from WASM to JS and gets validated by the browser, so the redundant ones aren't free
+class gl_state {
+public:
+  static constexpr int kMaxAttribs = 16;
+
+  struct call_counts {
+    long issued = 0;
+    long skipped = 0;
+  };
+
+  gl_state () { reset(); }
+
+  // forgets everything we know about the context, as when it's created or restored
+  void reset ();
+
+  void use_program (GLuint program);
+  void bind_buffer (GLenum target, GLuint buffer);
+  void bind_texture (GLuint texture); // on texture unit zero, the only one we use
+  void bind_framebuffer (GLuint framebuffer);
+
+  // the element array binding and the attribute state below belong to the vertex array, so they're forgotten
+  // whenever it changes (WebGL 2 only)
+  void bind_vertex_array (GLuint vertex_array);
+  void delete_vertex_array (GLuint vertex_array);
+
+  void set_vertex_attrib_array_enabled (GLuint index, bool enabled);
+  void vertex_attrib_pointer (GLuint index, GLint size, GLsizei stride, GLintptr offset); // always GL_FLOAT
+  void vertex_attrib_divisor (GLuint index, GLuint divisor);
+
+  // for callers doing their own change detection (uniform uploads, for instance)
+  void count_issued () {
+    ++counts_.issued;
+    PROFILE_COUNT("gl state calls", 1);
+  }
+  void count_skipped () { ++counts_.skipped; }
+
+  const call_counts& get_counts () const { return counts_; }
+  void reset_counts () { counts_ = call_counts(); }
+
+private:
+  struct attrib_pointer {
+    GLuint buffer;
+    GLint size;
+    GLsizei stride;
+    GLintptr offset;
+  };
+
+  static constexpr GLuint kUnknown = ~0u;
+
+  GLuint program_ = kUnknown;
+  GLuint array_buffer_ = kUnknown;
+  GLuint element_array_buffer_ = kUnknown;
+  GLuint texture_ = kUnknown;
+  GLuint framebuffer_ = kUnknown;
+  GLuint vertex_array_ = kUnknown;
+  int attribs_enabled_[kMaxAttribs];
+  attrib_pointer attrib_pointers_[kMaxAttribs];
+  GLuint attrib_divisors_[kMaxAttribs];
+  call_counts counts_;
+
+  void forget_vertex_array_state ();
+
+  // records a call as skipped if the cached value already matches, otherwise updates the cache and returns true
+  template<typename T>
+  bool update (T& cached, const T& value) {
+    if (cached == value) {
+      ++counts_.skipped;
+      return false;
+    }
+    cached = value;
+    count_issued();
+    return true;
+  }
+};
+
+extern gl_state gl_cache;
+
+#endif // GL_STATE_H
@@ -1,16 +1,255 @@
 #ifndef LOGIC_H
 #define LOGIC_H
 
-constexpr int kFieldCols = 9;
-constexpr int kFieldRows = 18;
+#include <cstdint>
+#include <random>
+#include <type_traits>
+#include <vector>
+
+#include "ball_grid.hpp"
+#include "ball_pool.hpp"
+#include "block_field.hpp"
+
+constexpr float kAspect = 9.0f / 16.0f;
+
+constexpr int kDefaultFieldCols = 9;
+constexpr int kDefaultFieldRows = 18;
+constexpr int kMaxFieldCols = 1024;
+constexpr int kMaxFieldRows = 1024;
+
+// the field may be narrower than the block bitmap allows, but never wider
+static_assert(kMaxFieldCols <= block_field::kMaxCols, "the widest field must fit a block_field row");
+constexpr float kFieldHeight = 1.0f;
+
+constexpr float kPaddleWidth = 0.2f;
+constexpr float kPaddleHeight = 0.05f;
+constexpr float kPaddleY = 0.5f / kAspect - kPaddleHeight * 0.5f;
+constexpr float kMaxPaddleX = 0.5f - kPaddleWidth * 0.5f;
+
+constexpr float kBallRadius = 0.025f;
+constexpr float kBallDiameter = kBallRadius * 2.0f;
+
+// the first two balls belong to the paddles and are always present; spawned balls follow them
+constexpr int kComputerBallIndex = 0;
+constexpr int kPlayerBallIndex = 1;
+constexpr int kOwnedBallCount = 2;
+
+// how many wall and block bounces the computer follows when predicting where a ball will reach its paddle; zero
+// means it just chases the balls
+constexpr int kDefaultPredictionDepth = 3;
+
+// the free functions below drive a single shared game, reporting its events to the listener set with
+// set_game_listener (nothing hears them until one is); tools that want several games at once use the game class
+// directly
+
+class game_listener;
+
+// the listener must outlive its use, or be unset (with null) first
+void set_game_listener (game_listener* listener);
+
+void reset_game ();
+
+// reseeds the computer's random choices; seeding and then resetting makes what follows depend only on the input
+void seed_game (unsigned seed);
 
 void set_player_position (float position);
 float get_player_position ();
+float get_computer_position (float alpha = 1.0f);
+
+void set_player_autopilot (bool enabled);
+
+// resizes the field (clamping to the maximum dimensions) and fills it with blocks
+void set_field_size (int rows, int cols);
+int get_field_rows ();
+int get_field_cols ();
 
+// returns true if the block has been cleared
 bool get_block_state (int row, int col);
 
+int get_ball_count ();
+
+// returns kComputerBallIndex or kPlayerBallIndex
+int get_ball_owner (int ball);
+
+// alpha interpolates between the positions before (0) and after (1) the last tick
+float get_ball_x (int ball, float alpha = 1.0f);
+float get_ball_y (int ball, float alpha = 1.0f);
+
+// adds a free ball (for multiball); it's removed once it leaves the field
+int spawn_ball (float x, float y, float vx, float vy, int owner);
+
 void maybe_release_player_ball ();
 
+// advances the simulation by one step; callers should use a fixed dt (see step_clock) for deterministic results
 void tick (float dt);
 
-#endif // LOGIC_H
\ No newline at end of file
+// a fingerprint of the simulation state, for checking that two runs played out the same way
+std::uint64_t get_game_state_hash ();
+
+// receives the events raised during game::tick, identifying balls by index
+class game_listener {
+public:
+  virtual ~game_listener () {}
+
+  virtual void clear_block (int /*row*/, int /*col*/) {}
+
+  // a block reported cleared is back, as when a rollback undoes the frame that cleared it
+  virtual void restore_block (int /*row*/, int /*col*/) {}
+
+  virtual void play_launch (int /*ball*/) {}
+  virtual void play_bounce (int /*ball*/) {}
+  virtual void play_loss (int /*ball*/) {}
+};
+
+// one match's worth of state (field, balls, paddles and the computer opponents), independent of any other, so that
+// many can run at once; the random engine driving the opponents is seeded explicitly, so a given seed and sequence
+// of inputs always plays out the same way
+class game {
+public:
+  class snapshot;
+
+  explicit game (game_listener& listener, unsigned seed = 0);
+
+  // puts the paddles and balls back to their starting positions and refills the field
+  void reset ();
+
+  // reseeds the opponents' random engine
+  void seed (unsigned seed) { engine_.seed(seed); }
+
+  void set_player_position (float position);
+  float get_player_position () const { return player_position_; }
+  float get_computer_position (float alpha = 1.0f) const {
+    return previous_computer_position_ + (computer_position_ - previous_computer_position_) * alpha;
+  }
+
+  void set_player_autopilot (bool enabled) { player_autopilot_ = enabled; }
+
+  // hands the top paddle (kComputerBallIndex's side) to a second human, driven like the player's
+  void set_opponent_human (bool human) { opponent_human_ = human; }
+  void set_opponent_position (float position);
+
+  // sets the difficulty of the computer playing the given side (kComputerBallIndex or, under autopilot,
+  // kPlayerBallIndex)
+  void set_prediction_depth (int side, int depth);
+  int get_prediction_depth (int side) const { return prediction_depths_[side]; }
+
+  void set_field_size (int rows, int cols);
+  int get_field_rows () const { return blocks_.get_rows(); }
+  int get_field_cols () const { return blocks_.get_cols(); }
+
+  bool get_block_state (int row, int col) const { return !blocks_.test(row, col); }
+  int get_block_count () const { return blocks_.get_block_count(); }
+
+  int get_ball_count () const { return balls_.size(); }
+  int get_ball_owner (int ball) const {
+    return (balls_.flags[ball] & kBallPlayerOwned) ? kPlayerBallIndex : kComputerBallIndex;
+  }
+  float get_ball_x (int ball, float alpha = 1.0f) const {
+    return balls_.previous_x[ball] + (balls_.x[ball] - balls_.previous_x[ball]) * alpha;
+  }
+  float get_ball_y (int ball, float alpha = 1.0f) const {
+    return balls_.previous_y[ball] + (balls_.y[ball] - balls_.previous_y[ball]) * alpha;
+  }
+  float get_ball_vx (int ball) const { return balls_.vx[ball]; }
+  float get_ball_vy (int ball) const { return balls_.vy[ball]; }
+
+  int spawn_ball (float x, float y, float vx, float vy, int owner);
+
+  void maybe_release_player_ball ();
+  void maybe_release_opponent_ball ();
+
+  void tick (float dt);
+
+  // copies everything that decides how the game plays on (all but the listener) into a snapshot, or back; takes
+  // microseconds for fields of ordinary size, so rollback can save every step and resimulate several in a frame
+  void save_state (snapshot& out) const;
+  void load_state (const snapshot& in);
+
+  std::uint64_t get_state_hash () const;
+
+  // how many ball pairs the last tick's grid tested for contact, and how many of them touched
+  long get_ball_pairs_tested () const { return ball_pairs_tested_; }
+  long get_ball_contacts () const { return ball_contacts_; }
+
+private:
+  class Ball;
+
+  struct computer_state {
+    float target_position = 0.0f;
+    bool target_position_initialized = false;
+  };
+
+  game_listener& listener_;
+
+  float computer_position_ = 0.0f;
+  float player_position_ = 0.0f;
+  float previous_computer_position_ = 0.0f;
+  bool player_autopilot_ = false;
+  bool opponent_human_ = false;
+
+  block_field blocks_;
+
+  // block dimensions, and how many blocks either side of the one containing its center a ball can reach
+  float block_width_;
+  float block_height_;
+  int reach_cols_;
+  int reach_rows_;
+
+  ball_pool balls_;
+  std::vector<ball_candidate> ball_candidates_;
+
+  // scratch space for ball-ball contacts, found afresh each step; the cells are a ball across, so a ball can only
+  // touch those in its own cell and the ones around it
+  ball_grid ball_grid_ {kBallDiameter, 0.5f, 0.5f / kAspect + kBallRadius};
+  std::vector<ball_pair> ball_pairs_;
+  long ball_pairs_tested_ = 0;
+  long ball_contacts_ = 0;
+
+  // scratch space for the sweep: the reachable column span of each row it covers
+  std::vector<int> reachable_cols_;
+
+  computer_state computer_states_[kOwnedBallCount];
+  std::default_random_engine engine_;
+
+  // bumped whenever cached predictions may have gone stale (a block clearing, say)
+  std::uint32_t prediction_epoch_ = 1;
+  int prediction_depths_[kOwnedBallCount] {kDefaultPredictionDepth, kDefaultPredictionDepth};
+
+  void fill_field (int rows, int cols);
+  void update_block_metrics ();
+  ball_bounds get_ball_bounds () const;
+  void collide_balls ();
+  void tick_computer (float dt, int ball_index, float& position);
+  int find_first_arrival (float side) const;
+  float get_predicted_x (int ball, float side, int depth);
+};
+
+// a saved game state.  saving into a snapshot that already holds a game with as many blocks and balls reuses its
+// storage, so once a set of them has warmed up, taking one every step never allocates
+class game::snapshot {
+private:
+  friend class game;
+
+  // everything besides the balls and blocks, as plain data
+  struct scalars {
+    float computer_position;
+    float player_position;
+    float previous_computer_position;
+    bool player_autopilot;
+    bool opponent_human;
+    computer_state computer_states[kOwnedBallCount];
+    std::default_random_engine engine;
+    std::uint32_t prediction_epoch;
+    int prediction_depths[kOwnedBallCount];
+  };
+  static_assert(std::is_trivially_copyable<scalars>::value, "snapshot scalars must be plain data");
+
+  scalars scalars_;
+  ball_pool balls_;
+  block_field blocks_;
+};
+
+// the game the free functions drive, for reading it as a whole
+const game& get_shared_game ();
+
+#endif // LOGIC_H
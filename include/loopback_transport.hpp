@@ -0,0 +1,65 @@
+#ifndef LOOPBACK_TRANSPORT_H
+#define LOOPBACK_TRANSPORT_H
+
+#include <random>
+#include <vector>
+
+#include "transport.hpp"
+
+// the network conditions a loopback link simulates, each way
+struct loopback_conditions {
+  // seconds from sending to delivery, plus up to jitter either side (so packets can overtake each other)
+  double latency = 0.05;
+  double jitter = 0.01;
+
+  // the fraction of packets dropped
+  double loss = 0.0;
+};
+
+// a pair of transports connected in-process, standing in for a real network so that networked play can run (and be
+// measured) on one machine.  time only moves when advanced, so runs are repeatable for a given seed
+class loopback_link {
+public:
+  explicit loopback_link (const loopback_conditions& conditions, unsigned seed = 0);
+
+  // the ends are 0 and 1
+  transport& get_end (int index) { return ends_[index]; }
+
+  void advance_time (double seconds) { time_ += seconds; }
+  double get_time () const { return time_; }
+
+  long get_packets_sent () const { return packets_sent_; }
+  long get_packets_dropped () const { return packets_dropped_; }
+
+private:
+  struct packet {
+    double delivery_time;
+    std::vector<unsigned char> data;
+  };
+
+  class end : public transport {
+  public:
+    end (loopback_link& link, int index) : link_(link), index_(index) {}
+
+    void send (const unsigned char* data, std::size_t size) override;
+    bool receive (std::vector<unsigned char>& packet) override;
+    double get_time () const override { return link_.time_; }
+
+  private:
+    loopback_link& link_;
+    int index_;
+  };
+
+  loopback_conditions conditions_;
+  std::default_random_engine engine_;
+  double time_ = 0.0;
+  long packets_sent_ = 0;
+  long packets_dropped_ = 0;
+
+  end ends_[2] {{*this, 0}, {*this, 1}};
+
+  // the packets on their way to each end
+  std::vector<packet> in_flight_[2];
+};
+
+#endif // LOOPBACK_TRANSPORT_H
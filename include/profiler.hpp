@@ -0,0 +1,67 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+// a scoped-zone profiler, built in only when PROFILER_ENABLED is defined (the BREAKTHROUGH_PROFILER CMake option);
+// otherwise the macros expand to nothing.  each thread records its zones into a ring buffer of its own, so recording
+// never takes a lock, and rolls per-frame totals into a short history for percentiles
+#ifdef PROFILER_ENABLED
+
+#include <cstdint>
+#include <ostream>
+#include <vector>
+
+namespace profiler {
+
+// times the enclosing scope; the name must outlive the profiler (a string literal, say)
+class zone {
+public:
+  explicit zone (const char* name);
+  ~zone ();
+
+private:
+  const char* name_;
+  std::int64_t start_;
+};
+
+// adds to a per-frame counter on the calling thread
+void count (const char* name, long value);
+
+// closes the calling thread's current frame, rolling its zone totals and counters into the history
+void end_frame ();
+
+// percentiles over the recent frames ended on each thread (the calling thread's first): milliseconds for the frame
+// itself and each zone, raw values for counters
+struct series_stats {
+  const char* name;
+  bool counter;
+
+  // zero for the calling thread, otherwise the thread's id in the trace
+  int thread;
+
+  float p50;
+  float p90;
+  float p99;
+};
+std::vector<series_stats> get_frame_stats ();
+
+// writes everything still in the ring buffers, from every thread, as Chrome trace-event JSON (for chrome://tracing
+// or Perfetto); other threads should be idle while this runs
+void write_trace (std::ostream& out);
+
+}
+
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+#define PROFILE_ZONE(name) profiler::zone PROFILE_CONCAT(profile_zone_, __LINE__)(name)
+#define PROFILE_COUNT(name, value) profiler::count(name, value)
+#define PROFILE_END_FRAME() profiler::end_frame()
+
+#else
+
+#define PROFILE_ZONE(name) ((void)0)
+#define PROFILE_COUNT(name, value) ((void)0)
+#define PROFILE_END_FRAME() ((void)0)
+
+#endif
+
+#endif // PROFILER_H
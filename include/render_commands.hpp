@@ -0,0 +1,126 @@
+#ifndef RENDER_COMMANDS_H
+#define RENDER_COMMANDS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "fnv_hash.hpp"
+#include "sim_frame.hpp"
+
+// a quad to draw, in field coordinates, with what to draw it with named by small ids that a backend maps onto its
+// own programs and textures.  commands are plain data, so a frame's worth is just an array
+struct render_command {
+  // passes are drawn in order, each to its own target: the changed blocks uploaded to the block texture (the quad
+  // being the blocks' columns and rows), the wall of blocks drawn into its layer, the scene (the backdrop with the
+  // wall over it) into its own, then the frame: the scene as its opaque background, then the sprites blended over it
+  enum pass_type : std::uint8_t { kBlockUploads, kWall, kScene, kBackground, kSprites };
+  enum program_type : std::uint8_t { kBackdrop, kPaddle, kBall, kBlocks, kBlit, kParticles };
+  enum texture_type : std::uint8_t { kNoTexture, kSceneTexture, kBlockTexture, kWallTexture };
+
+  pass_type pass;
+  program_type program;
+  texture_type texture;
+  float x, y, w, h;
+};
+
+// draws sorted commands
+class render_backend {
+public:
+  virtual ~render_backend () {}
+
+  virtual void submit (const render_command* commands, std::size_t count) = 0;
+};
+
+// collects a frame's commands, then sorts them by pass, program and texture (keeping the order they were added in
+// otherwise) so that the backend sees each program's draws together.  the storage is kept from frame to frame, so
+// once it has grown to fit a frame, queueing the next allocates nothing
+class command_buffer {
+public:
+  void clear ();
+
+  void add (render_command::pass_type pass, render_command::program_type program,
+    render_command::texture_type texture, float x, float y, float w, float h);
+
+  std::size_t get_size () const { return commands_.size(); }
+
+  void submit (render_backend& backend);
+
+private:
+  std::vector<render_command> commands_;
+
+  // the sort key in the high bits, the index in the low
+  std::vector<std::uint64_t> keys_;
+  std::vector<render_command> sorted_;
+};
+
+// the blocks cleared since the last frame, as a span of columns in each row, for bringing a frontend's copy of the
+// field up to date with as few uploads as it takes
+class block_changes {
+public:
+  // sizes for a field with nothing changed
+  void reset (int rows, int cols);
+
+  void clear_block (int row, int col);
+
+  bool is_empty () const { return min_row_ > max_row_; }
+
+  // queues the uploads covering the changes, then forgets them
+  void queue_uploads (command_buffer& out);
+
+private:
+  int cols_ = 0;
+  std::vector<int> min_cols_;
+  std::vector<int> max_cols_;
+  int min_row_ = 0;
+  int max_row_ = -1;
+};
+
+// what goes into a frame besides the state of the game
+struct frame_options {
+  // how far through the frame's step to interpolate
+  float alpha = 1.0f;
+
+  // the player's paddle is drawn where the input has it rather than where the last step left it
+  float player_position = 0.0f;
+
+  // the wall's layer has lost its contents (on being resized, say) and must be drawn again even with no blocks
+  // changed; the backdrop animation has moved on, so the scene must be drawn again even with the wall as it was
+  bool wall_dirty = false;
+  bool backdrop_due = false;
+
+  bool particles_live = false;
+};
+
+// queues a frame of the game: the uploads of any blocks changed (which are then forgotten), the wall and scene layers
+// where they need drawing again, the scene as the background, then the paddles, the balls and the particles
+void queue_frame (const sim_frame& frame, const frame_options& options, block_changes& blocks, command_buffer& out);
+
+// draws nothing, for measuring the cost of everything up to the GL calls
+class null_render_backend : public render_backend {
+public:
+  void submit (const render_command*, std::size_t count) override { command_count_ += count; }
+
+  long get_command_count () const { return command_count_; }
+
+private:
+  long command_count_ = 0;
+};
+
+// keeps the last frame's commands and a hash of every frame submitted, so that a deterministic run (a replay, say)
+// can be checked against the output it's known to produce
+class recording_render_backend : public render_backend {
+public:
+  void submit (const render_command* commands, std::size_t count) override;
+
+  const std::vector<render_command>& get_last_frame () const { return last_frame_; }
+  std::uint64_t get_hash () const { return hash_.get(); }
+  long get_frame_count () const { return frame_count_; }
+
+private:
+  std::vector<render_command> last_frame_;
+  fnv_hasher hash_;
+  long frame_count_ = 0;
+};
+
+#endif // RENDER_COMMANDS_H
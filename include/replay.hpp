@@ -0,0 +1,69 @@
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// recorded (and networked) paddle positions are fixed point, in 1/65536ths of the field width; a game fed the
+// rounded positions plays out the same wherever they're applied
+constexpr float kPaddlePositionScale = 65536.0f;
+
+inline std::int32_t quantize_paddle_position (float position) {
+  return (std::int32_t)std::lround(position * kPaddlePositionScale);
+}
+
+inline float dequantize_paddle_position (std::int32_t position) {
+  return position / kPaddlePositionScale;
+}
+
+// a recorded session: everything needed to play it back step for step (the seed, the step rate, the field and the
+// opponent's difficulty, then the player's input at each step), plus a hash of the final state to check the result
+// against.  on disk, after a short header, each step is a single varint holding the zigzagged change in the paddle's
+// (fixed-point) position and a release bit, so a paddle at rest costs a byte per step
+struct replay_step {
+  float player_position;
+  bool release;
+};
+
+struct replay {
+  unsigned seed;
+  float step_rate;
+  int rows;
+  int cols;
+  int prediction_depth;
+  std::uint64_t final_hash;
+  std::vector<replay_step> steps;
+};
+
+// returns false if the data isn't a replay (or is truncated)
+bool decode_replay (const unsigned char* data, std::size_t size, replay& out);
+
+// collects a session's input as it's played
+class replay_recorder {
+public:
+  // starts over; the game should have just been seeded and reset with these settings
+  void begin (unsigned seed, float step_rate, int rows, int cols, int prediction_depth);
+
+  // records the input for the step about to run, returning the position rounded as it'll be replayed: apply that
+  // rather than the original, so that the recorded game is the one that replays
+  float record_step (float player_position, bool release);
+
+  long get_step_count () const { return step_count_; }
+
+  // encodes the session so far, given the state hash after its last step
+  std::vector<unsigned char> finish (std::uint64_t final_hash) const;
+
+private:
+  unsigned seed_ = 0;
+  float step_rate_ = 0.0f;
+  int rows_ = 0;
+  int cols_ = 0;
+  int prediction_depth_ = 0;
+  long step_count_ = 0;
+  std::int32_t last_position_ = 0;
+  std::vector<unsigned char> steps_;
+};
+
+#endif // REPLAY_H
@@ -0,0 +1,53 @@
+#ifndef RESOLUTION_CONTROLLER_H
+#define RESOLUTION_CONTROLLER_H
+
+constexpr float kDefaultMinScale = 0.5f;
+constexpr float kDefaultMaxScale = 1.0f;
+constexpr float kDefaultTargetFrameRate = 60.0f;
+
+// picks a render scale (a fraction of the full canvas resolution) from observed frame times: it lowers the scale as
+// soon as frames run consistently over budget, but raises it only after a sustained stretch within budget.  a raise
+// that immediately runs over budget is taken back, and the scale it reached is then off limits for a while, so that
+// it settles just below the affordable scale rather than oscillating around it
+class resolution_controller {
+public:
+  resolution_controller (
+    float min_scale = kDefaultMinScale, float max_scale = kDefaultMaxScale,
+    float target_rate = kDefaultTargetFrameRate);
+
+  void set_bounds (float min_scale, float max_scale);
+  float get_min_scale () const { return min_scale_; }
+  float get_max_scale () const { return max_scale_; }
+
+  // in frames per second; a rate that isn't positive and finite is ignored, leaving the target as it was (the default,
+  // on construction)
+  void set_target_rate (float target_rate);
+  float get_target_rate () const { return target_rate_; }
+
+  float get_scale () const { return scale_; }
+
+  // records the duration of the last frame in seconds, returning true if the scale changed as a result
+  bool update (double frame_time);
+
+private:
+  float min_scale_;
+  float max_scale_;
+  float target_rate_ = kDefaultTargetFrameRate;
+  float scale_;
+
+  double average_frame_time_ = 1.0 / kDefaultTargetFrameRate;
+  double slow_time_ = 0.0;
+  double steady_time_ = 0.0;
+
+  // the scale before the last raise and the time since it, while the raise is still on probation
+  float scale_before_raise_;
+  double since_raise_ = -1.0;
+
+  // the lowest scale at which a raise has failed recently (zero if none), and how long ago
+  float failed_scale_ = 0.0f;
+  double since_failure_ = 0.0;
+
+  void set_scale (float scale);
+};
+
+#endif // RESOLUTION_CONTROLLER_H
@@ -0,0 +1,163 @@
+#ifndef ROLLBACK_SESSION_H
+#define ROLLBACK_SESSION_H
+
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+#include "logic.hpp"
+#include "snapshot_ring.hpp"
+#include "transport.hpp"
+
+// a paddle's input for one frame, with the position in fixed point (see quantize_paddle_position) so that both peers
+// apply exactly the same value
+struct paddle_input {
+  std::int32_t position;
+  bool release;
+};
+
+struct rollback_config {
+  // frames that local input is held back before it takes effect, giving it time to reach the peer: fewer rollbacks
+  // for that much added latency
+  int input_delay = 2;
+
+  // how many frames the simulation may run past the last input received from the peer, predicting the rest; beyond
+  // that it stalls until more arrives
+  int max_prediction = 8;
+};
+
+struct rollback_metrics {
+  long frames = 0;
+  long stalls = 0;
+  long rollbacks = 0;
+  long resimulated_frames = 0;
+  int longest_rollback = 0;
+  double resimulation_seconds = 0.0;
+
+  // inputs shown, and the total seconds (on the transport's clock, so counting stalls) from each being made to the
+  // first frame here that ran with it: local inputs wait out the input delay, the peer's the trip over the link
+  long local_inputs = 0;
+  double local_input_latency_seconds = 0.0;
+  long remote_inputs = 0;
+  double remote_input_latency_seconds = 0.0;
+};
+
+// one peer of a two-human game in which each peer runs the whole simulation itself: its own input goes in straight
+// away (after the input delay) and the peer's is predicted (the last position received, holding still) until it
+// arrives, at which point any frames run on a wrong guess are rolled back and run again.  sounds from rerun frames
+// aren't passed on, so a bounce isn't heard twice (nor, if the rerun differs, at all); blocks are, as the difference
+// between what the abandoned frames cleared and what the rerun did, so that the listener's view of the field follows
+class rollback_session {
+public:
+  // both peers need the same seed and step rate, and opposite sides (kPlayerBallIndex is the bottom paddle,
+  // kComputerBallIndex the top)
+  rollback_session (game_listener& listener, transport& link, int local_side, unsigned seed, float step_rate,
+    const rollback_config& config = rollback_config());
+
+  // the game as it should be shown: up to date with local input, predicting the peer's
+  const game& get_game () const { return game_; }
+
+  // takes in whatever the peer has sent (rolling back if it contradicts a prediction), then runs a frame with the
+  // given local input; returns false, without running it, if that would mean predicting too far ahead of the peer
+  bool advance (float local_position, bool local_release);
+
+  // takes in and resends input without running a frame
+  void poll ();
+
+  long get_frame () const { return frame_; }
+
+  // frames before this have run with the peer's actual input (and none from a desync on)
+  long get_confirmed_frame () const { return std::min({remote_frames_, frame_, desync_frame_}); }
+
+  // the peer's input called for rolling back to a frame whose snapshot was no longer held, so the game can't be put
+  // right; from then on the session runs no more frames and takes in no more input
+  bool is_desynced () const { return desync_frame_ != std::numeric_limits<long>::max(); }
+
+  const rollback_metrics& get_metrics () const { return metrics_; }
+
+private:
+  // passes events on, except while frames are rerun: then sounds are dropped, and the blocks cleared are only
+  // reported once the rerun is over, against those the frames it replaced had cleared
+  class event_filter : public game_listener {
+  public:
+    explicit event_filter (game_listener& target) : target_(target) {}
+
+    void set_frame (long frame) { frame_ = frame; }
+
+    void begin_rerun (long frame);
+    void end_rerun ();
+
+    // forgets the blocks cleared before the given frame, which can no longer be rolled back
+    void confirm (long frame);
+
+    void clear_block (int row, int col) override;
+
+    void play_launch (int ball) override { if (!rerunning_) target_.play_launch(ball); }
+    void play_bounce (int ball) override { if (!rerunning_) target_.play_bounce(ball); }
+    void play_loss (int ball) override { if (!rerunning_) target_.play_loss(ball); }
+
+  private:
+    struct block_clear {
+      long frame;
+      int row;
+      int col;
+    };
+
+    game_listener& target_;
+    long frame_ = 0;
+    bool rerunning_ = false;
+
+    // the blocks cleared in frames that may yet be rolled back, in frame order; then, during a rerun, those its
+    // frames cleared the first time round and those they've cleared this time
+    std::vector<block_clear> clears_;
+    std::vector<block_clear> undone_clears_;
+    std::vector<block_clear> rerun_clears_;
+  };
+
+  transport& link_;
+  int local_side_;
+  float step_duration_;
+  rollback_config config_;
+  event_filter events_;
+  game game_;
+  snapshot_ring snapshots_;
+
+  // the next frame to run
+  long frame_ = 0;
+
+  // the frame that couldn't be rolled back to, if any
+  long desync_frame_ = std::numeric_limits<long>::max();
+
+  // inputs by frame, in rings: local input is known for frames before local_frames_, and the peer's (contiguously)
+  // for frames before remote_frames_, beyond which some may have arrived early
+  std::vector<paddle_input> local_inputs_;
+  long local_frames_;
+  std::vector<paddle_input> remote_inputs_;
+  std::vector<long> remote_input_frames_;
+  long remote_frames_;
+
+  // when each input was made, in microseconds on the transport's clock (wrapping, which matters only for spans of
+  // over an hour)
+  std::vector<std::uint32_t> local_input_stamps_;
+  std::vector<std::uint32_t> remote_input_stamps_;
+
+  // the peer's input each frame actually ran with, to spot wrong predictions
+  std::vector<paddle_input> used_remote_inputs_;
+
+  // the peer has all of our input for frames before this
+  long acknowledged_frames_ = 0;
+
+  std::vector<unsigned char> packet_;
+  rollback_metrics metrics_;
+
+  int get_slot (long frame) const { return (int)(frame % (long)local_inputs_.size()); }
+  std::uint32_t get_stamp () const;
+  double get_seconds_since (std::uint32_t stamp) const;
+  void receive_input ();
+  void send_input ();
+  void run_frame (long frame);
+  void roll_back (long frame);
+};
+
+#endif // ROLLBACK_SESSION_H
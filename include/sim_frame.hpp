@@ -0,0 +1,34 @@
+#ifndef SIM_FRAME_H
+#define SIM_FRAME_H
+
+#include <vector>
+
+#include "logic.hpp"
+
+// what drawing needs from the game after a step: the paddles and balls before and after it, so that the renderer
+// can interpolate without touching the game itself (which may be running ahead on another thread)
+struct sim_frame {
+  long step = 0;
+
+  // when the step finished, in seconds (on whatever clock the simulation keeps)
+  double time = 0.0;
+
+  float previous_computer_position = 0.0f;
+  float computer_position = 0.0f;
+  float player_position = 0.0f;
+
+  int ball_count = 0;
+  std::vector<float> previous_x, previous_y;
+  std::vector<float> x, y;
+
+  // copies the game's current state, reusing the arrays' storage
+  void capture (const game& source, long step, double time);
+
+  float get_computer_position (float alpha) const {
+    return previous_computer_position + (computer_position - previous_computer_position) * alpha;
+  }
+  float get_ball_x (int ball, float alpha) const { return previous_x[ball] + (x[ball] - previous_x[ball]) * alpha; }
+  float get_ball_y (int ball, float alpha) const { return previous_y[ball] + (y[ball] - previous_y[ball]) * alpha; }
+};
+
+#endif // SIM_FRAME_H
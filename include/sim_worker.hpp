@@ -0,0 +1,119 @@
+#ifndef SIM_WORKER_H
+#define SIM_WORKER_H
+
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "logic.hpp"
+#include "replay.hpp"
+#include "sim_frame.hpp"
+#include "spsc_queue.hpp"
+#include "step_clock.hpp"
+#include "triple_buffer.hpp"
+
+// a game event, passed from the simulation thread to be handled on the main thread
+struct sim_event {
+  enum kind_type { kClearBlock, kLaunch, kBounce, kLoss };
+
+  kind_type kind;
+
+  // the row and column of a cleared block, or the ball and its owner
+  int a;
+  int b;
+};
+
+// runs a game at a fixed step rate on a thread of its own, so that a stall on the main thread (a slow GL call, a
+// garbage collection) doesn't hold up the simulation.  the two threads only meet through lock-free structures: input
+// goes in through one queue, events come out through another and each step's result is published through a triple
+// buffer, of which the main thread reads only the latest
+class sim_worker {
+public:
+  sim_worker (unsigned seed, float step_rate = kDefaultStepRate, int rows = kDefaultFieldRows,
+    int cols = kDefaultFieldCols);
+  ~sim_worker ();
+
+  void start ();
+  void stop ();
+
+  // main thread: sets the player's paddle position (and asks to launch its ball) from the next step on
+  void send_input (float player_position, bool release);
+
+  // main thread: the latest completed step
+  const sim_frame& acquire_frame () { return frames_.acquire(); }
+
+  // main thread: calls fn(event) for each event raised since the last call
+  template<typename F>
+  void drain_events (F fn) {
+    sim_event event;
+    while (events_.pop(event)) fn(event);
+  }
+
+  // main thread: asks for the session so far as a replay, which take_replay returns once the worker has encoded it
+  void request_replay () { replay_requested_.store(true, std::memory_order_release); }
+  std::unique_ptr<std::vector<unsigned char>> take_replay () {
+    return std::unique_ptr<std::vector<unsigned char>>(replay_.exchange(nullptr, std::memory_order_acq_rel));
+  }
+
+  // seconds on the clock that frames are stamped with
+  static double now ();
+
+  float get_step_duration () const { return clock_.get_step_duration(); }
+  int get_rows () const { return game_.get_field_rows(); }
+  int get_cols () const { return game_.get_field_cols(); }
+
+  // safe only while stopped
+  long get_step () const { return step_; }
+  const game& get_game () const { return game_; }
+
+private:
+  struct input {
+    float player_position;
+    bool release;
+  };
+
+  // queues events for the main thread; if it's fallen so far behind that the queue is full, the worker waits for it
+  // rather than lose a block
+  class event_queue_listener : public game_listener {
+  public:
+    explicit event_queue_listener (sim_worker& worker) : worker_(worker) {}
+
+    void clear_block (int row, int col) override { worker_.push_event({sim_event::kClearBlock, row, col}); }
+
+    void play_launch (int ball) override { push_ball_event(sim_event::kLaunch, ball); }
+    void play_bounce (int ball) override { push_ball_event(sim_event::kBounce, ball); }
+    void play_loss (int ball) override { push_ball_event(sim_event::kLoss, ball); }
+
+  private:
+    sim_worker& worker_;
+
+    void push_ball_event (sim_event::kind_type kind, int ball) {
+      worker_.push_event({kind, ball, worker_.game_.get_ball_owner(ball)});
+    }
+  };
+
+  event_queue_listener listener_;
+  game game_;
+  step_clock clock_;
+  replay_recorder recorder_;
+  long step_ = 0;
+
+  // the input as of the last step, kept by the worker
+  input current_input_ {0.0f, false};
+
+  spsc_queue<input> inputs_;
+  spsc_queue<sim_event> events_;
+  triple_buffer<sim_frame> frames_;
+  std::atomic<bool> replay_requested_ {false};
+  std::atomic<std::vector<unsigned char>*> replay_ {nullptr};
+
+  std::atomic<bool> running_ {false};
+  std::thread thread_;
+
+  void run ();
+  void push_event (const sim_event& event);
+  void publish_frame ();
+};
+
+#endif // SIM_WORKER_H
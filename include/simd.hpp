@@ -0,0 +1,145 @@
+#ifndef SIMD_H
+#define SIMD_H
+
+#include <cmath>
+#include <cstdint>
+
+// four-wide float operations, backed by WASM SIMD128 on the web, SSE2 on x86 and plain loops elsewhere.  there's no
+// eight-wide AVX path: SIMD128 is four wide, so the game's one kernel is too, and the native tools are built for
+// baseline x86-64, which lacks AVX
+#if defined(__wasm_simd128__)
+#include <wasm_simd128.h>
+#define SIMD_WASM 1
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define SIMD_SSE 1
+#endif
+
+namespace simd {
+
+constexpr int kWidth = 4;
+
+#if defined(SIMD_WASM)
+
+struct float4 { v128_t v; };
+struct mask4 { v128_t v; };
+
+inline float4 load (const float* p) { return {wasm_v128_load(p)}; }
+inline void store (float* p, float4 a) { wasm_v128_store(p, a.v); }
+inline float4 splat (float s) { return {wasm_f32x4_splat(s)}; }
+
+inline float4 operator+ (float4 a, float4 b) { return {wasm_f32x4_add(a.v, b.v)}; }
+inline float4 operator- (float4 a, float4 b) { return {wasm_f32x4_sub(a.v, b.v)}; }
+inline float4 operator* (float4 a, float4 b) { return {wasm_f32x4_mul(a.v, b.v)}; }
+inline float4 operator/ (float4 a, float4 b) { return {wasm_f32x4_div(a.v, b.v)}; }
+inline float4 sqrt (float4 a) { return {wasm_f32x4_sqrt(a.v)}; }
+inline float4 min (float4 a, float4 b) { return {wasm_f32x4_pmin(a.v, b.v)}; }
+inline float4 max (float4 a, float4 b) { return {wasm_f32x4_pmax(a.v, b.v)}; }
+inline float4 abs (float4 a) { return {wasm_f32x4_abs(a.v)}; }
+
+inline mask4 operator< (float4 a, float4 b) { return {wasm_f32x4_lt(a.v, b.v)}; }
+inline mask4 operator> (float4 a, float4 b) { return {wasm_f32x4_gt(a.v, b.v)}; }
+inline mask4 operator| (mask4 a, mask4 b) { return {wasm_v128_or(a.v, b.v)}; }
+inline mask4 operator& (mask4 a, mask4 b) { return {wasm_v128_and(a.v, b.v)}; }
+
+// lanes of the mask select a, others b
+inline float4 select (mask4 m, float4 a, float4 b) { return {wasm_v128_bitselect(a.v, b.v, m.v)}; }
+inline int bits (mask4 m) { return wasm_i32x4_bitmask(m.v); }
+
+// lanes in which any of the given flag bits are set
+inline mask4 test_flags (const std::uint32_t* p, std::uint32_t flags) {
+  auto masked = wasm_v128_and(wasm_v128_load(p), wasm_i32x4_splat(flags));
+  return {wasm_v128_not(wasm_i32x4_eq(masked, wasm_i32x4_splat(0)))};
+}
+
+#elif defined(SIMD_SSE)
+
+struct float4 { __m128 v; };
+struct mask4 { __m128 v; };
+
+inline float4 load (const float* p) { return {_mm_loadu_ps(p)}; }
+inline void store (float* p, float4 a) { _mm_storeu_ps(p, a.v); }
+inline float4 splat (float s) { return {_mm_set1_ps(s)}; }
+
+inline float4 operator+ (float4 a, float4 b) { return {_mm_add_ps(a.v, b.v)}; }
+inline float4 operator- (float4 a, float4 b) { return {_mm_sub_ps(a.v, b.v)}; }
+inline float4 operator* (float4 a, float4 b) { return {_mm_mul_ps(a.v, b.v)}; }
+inline float4 operator/ (float4 a, float4 b) { return {_mm_div_ps(a.v, b.v)}; }
+inline float4 sqrt (float4 a) { return {_mm_sqrt_ps(a.v)}; }
+inline float4 min (float4 a, float4 b) { return {_mm_min_ps(a.v, b.v)}; }
+inline float4 max (float4 a, float4 b) { return {_mm_max_ps(a.v, b.v)}; }
+inline float4 abs (float4 a) { return {_mm_andnot_ps(_mm_set1_ps(-0.0f), a.v)}; }
+
+inline mask4 operator< (float4 a, float4 b) { return {_mm_cmplt_ps(a.v, b.v)}; }
+inline mask4 operator> (float4 a, float4 b) { return {_mm_cmpgt_ps(a.v, b.v)}; }
+inline mask4 operator| (mask4 a, mask4 b) { return {_mm_or_ps(a.v, b.v)}; }
+inline mask4 operator& (mask4 a, mask4 b) { return {_mm_and_ps(a.v, b.v)}; }
+
+inline float4 select (mask4 m, float4 a, float4 b) {
+  return {_mm_or_ps(_mm_and_ps(m.v, a.v), _mm_andnot_ps(m.v, b.v))};
+}
+inline int bits (mask4 m) { return _mm_movemask_ps(m.v); }
+
+inline mask4 test_flags (const std::uint32_t* p, std::uint32_t flags) {
+  auto masked = _mm_and_si128(_mm_loadu_si128((const __m128i*)p), _mm_set1_epi32(flags));
+  auto clear = _mm_cmpeq_epi32(masked, _mm_setzero_si128());
+  return {_mm_castsi128_ps(_mm_xor_si128(clear, _mm_set1_epi32(-1)))};
+}
+
+#else
+
+struct float4 { float v[kWidth]; };
+struct mask4 { bool v[kWidth]; };
+
+template<typename F>
+inline float4 map (float4 a, float4 b, F f) {
+  float4 r;
+  for (auto i = 0; i < kWidth; ++i) r.v[i] = f(a.v[i], b.v[i]);
+  return r;
+}
+
+template<typename F>
+inline mask4 compare (float4 a, float4 b, F f) {
+  mask4 r;
+  for (auto i = 0; i < kWidth; ++i) r.v[i] = f(a.v[i], b.v[i]);
+  return r;
+}
+
+inline float4 load (const float* p) { return {{p[0], p[1], p[2], p[3]}}; }
+inline void store (float* p, float4 a) { for (auto i = 0; i < kWidth; ++i) p[i] = a.v[i]; }
+inline float4 splat (float s) { return {{s, s, s, s}}; }
+
+inline float4 operator+ (float4 a, float4 b) { return map(a, b, [](float x, float y) { return x + y; }); }
+inline float4 operator- (float4 a, float4 b) { return map(a, b, [](float x, float y) { return x - y; }); }
+inline float4 operator* (float4 a, float4 b) { return map(a, b, [](float x, float y) { return x * y; }); }
+inline float4 operator/ (float4 a, float4 b) { return map(a, b, [](float x, float y) { return x / y; }); }
+inline float4 sqrt (float4 a) { return map(a, a, [](float x, float) { return std::sqrt(x); }); }
+inline float4 min (float4 a, float4 b) { return map(a, b, [](float x, float y) { return y < x ? y : x; }); }
+inline float4 max (float4 a, float4 b) { return map(a, b, [](float x, float y) { return x < y ? y : x; }); }
+inline float4 abs (float4 a) { return map(a, a, [](float x, float) { return x < 0.0f ? -x : x; }); }
+
+inline mask4 operator< (float4 a, float4 b) { return compare(a, b, [](float x, float y) { return x < y; }); }
+inline mask4 operator> (float4 a, float4 b) { return compare(a, b, [](float x, float y) { return x > y; }); }
+inline mask4 operator| (mask4 a, mask4 b) {
+  return {{a.v[0] || b.v[0], a.v[1] || b.v[1], a.v[2] || b.v[2], a.v[3] || b.v[3]}};
+}
+inline mask4 operator& (mask4 a, mask4 b) {
+  return {{a.v[0] && b.v[0], a.v[1] && b.v[1], a.v[2] && b.v[2], a.v[3] && b.v[3]}};
+}
+
+inline float4 select (mask4 m, float4 a, float4 b) {
+  float4 r;
+  for (auto i = 0; i < kWidth; ++i) r.v[i] = m.v[i] ? a.v[i] : b.v[i];
+  return r;
+}
+inline int bits (mask4 m) { return m.v[0] | m.v[1] << 1 | m.v[2] << 2 | m.v[3] << 3; }
+
+inline mask4 test_flags (const std::uint32_t* p, std::uint32_t flags) {
+  return {{(p[0] & flags) != 0, (p[1] & flags) != 0, (p[2] & flags) != 0, (p[3] & flags) != 0}};
+}
+
+#endif
+
+}
+
+#endif // SIMD_H
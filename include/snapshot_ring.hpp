@@ -0,0 +1,35 @@
+#ifndef SNAPSHOT_RING_H
+#define SNAPSHOT_RING_H
+
+#include <vector>
+
+#include "logic.hpp"
+
+// the snapshots of the last few steps of a game, for rolling back to; the storage for all of them is allocated up
+// front (sized from the game as it stands), so saving every step stays allocation-free
+class snapshot_ring {
+public:
+  snapshot_ring (int capacity, const game& prototype);
+
+  int get_capacity () const { return (int)snapshots_.size(); }
+
+  // forgets every snapshot, keeping the storage
+  void clear ();
+
+  // saves the state as of the given step, overwriting the oldest snapshot once the ring is full
+  void save (const game& source, long step);
+
+  // restores the state as of the given step, returning false if that snapshot isn't held (never saved, or already
+  // overwritten)
+  bool load (game& target, long step) const;
+
+  bool contains (long step) const;
+
+private:
+  std::vector<game::snapshot> snapshots_;
+  std::vector<long> steps_;
+
+  int get_slot (long step) const { return (int)(step % (long)snapshots_.size()); }
+};
+
+#endif // SNAPSHOT_RING_H
@@ -0,0 +1,48 @@
+#ifndef SPSC_QUEUE_H
+#define SPSC_QUEUE_H
+
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+// a bounded first-in first-out queue between one producer thread and one consumer thread, without locks: each side
+// only ever writes its own index
+template<typename T>
+class spsc_queue {
+public:
+  explicit spsc_queue (std::size_t capacity) : slots_(capacity + 1) {}
+
+  // returns false (dropping nothing) if the queue is full
+  bool push (const T& value) {
+    auto tail = tail_.value.load(std::memory_order_relaxed);
+    auto next = advance(tail);
+    if (next == head_.value.load(std::memory_order_acquire)) return false;
+    slots_[tail] = value;
+    tail_.value.store(next, std::memory_order_release);
+    return true;
+  }
+
+  // returns false if the queue is empty
+  bool pop (T& value) {
+    auto head = head_.value.load(std::memory_order_relaxed);
+    if (head == tail_.value.load(std::memory_order_acquire)) return false;
+    value = slots_[head];
+    head_.value.store(advance(head), std::memory_order_release);
+    return true;
+  }
+
+private:
+  // padded out to a cache line, so that the two threads don't contend for one
+  struct padded_index {
+    std::atomic<std::size_t> value {0};
+    char padding[64 - sizeof(std::atomic<std::size_t>)];
+  };
+
+  std::vector<T> slots_;
+  padded_index head_;
+  padded_index tail_;
+
+  std::size_t advance (std::size_t index) const { return (index + 1 == slots_.size()) ? 0 : index + 1; }
+};
+
+#endif // SPSC_QUEUE_H
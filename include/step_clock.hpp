@@ -0,0 +1,41 @@
+#ifndef STEP_CLOCK_H
+#define STEP_CLOCK_H
+
+#include <limits>
+
+constexpr float kDefaultStepRate = 120.0f;
+constexpr int kDefaultMaxSteps = 8;
+
+// whether a step rate gives a usable step duration: positive and finite (NaN is neither)
+inline bool is_valid_step_rate (float step_rate) {
+  return step_rate > 0.0f && step_rate <= std::numeric_limits<float>::max();
+}
+
+// converts variable frame times into a whole number of fixed-duration simulation steps
+class step_clock {
+public:
+  step_clock (float step_rate = kDefaultStepRate, int max_steps = kDefaultMaxSteps);
+
+  // a rate that isn't valid is ignored, leaving the clock at the one it had (the default, on construction)
+  void set_step_rate (float step_rate);
+  float get_step_rate () const { return step_rate_; }
+  float get_step_duration () const { return step_duration_; }
+
+  void set_max_steps (int max_steps) { max_steps_ = max_steps; }
+  int get_max_steps () const { return max_steps_; }
+
+  // adds elapsed time and returns the number of steps to run; any time beyond max_steps is dropped rather than
+  // carried over, so a long stall doesn't turn into a burst of catch-up work
+  int advance (double dt);
+
+  // the fraction of a step left over in the accumulator, for interpolating between the last two simulated states
+  float get_alpha () const { return (float)(accumulator_ / step_duration_); }
+
+private:
+  float step_rate_ = kDefaultStepRate;
+  float step_duration_ = 1.0f / kDefaultStepRate;
+  int max_steps_;
+  double accumulator_ = 0.0;
+};
+
+#endif // STEP_CLOCK_H
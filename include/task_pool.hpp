@@ -0,0 +1,69 @@
+#ifndef TASK_POOL_H
+#define TASK_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// a fixed set of worker threads, each with its own task deque: workers run their own tasks newest first and, when
+// they run dry, steal the oldest tasks from the others, so uneven tasks (matches that run long, say) balance out
+class task_pool {
+public:
+  // zero threads means one per hardware thread
+  explicit task_pool (int thread_count = 0);
+  ~task_pool ();
+
+  int get_thread_count () const { return (int)threads_.size(); }
+
+  // tasks submitted from a worker go on its own deque; others are dealt out round robin
+  void submit (std::function<void()> task);
+
+  // runs tasks on the calling thread as well until everything submitted so far has finished
+  void wait ();
+
+  // calls fn with every index in [0, count) across the workers and the calling thread, returning once all have
+  // finished.  the indices are handed out from a counter rather than queued as tasks, so that nothing is allocated:
+  // fn is referred to, not copied, and must outlive the call
+  void run_indexed (int count, const std::function<void(int)>& fn);
+
+private:
+  struct worker_queue {
+    std::mutex mutex;
+    std::deque<std::function<void()>> tasks;
+  };
+
+  std::vector<std::unique_ptr<worker_queue>> queues_;
+  std::vector<std::thread> threads_;
+
+  // tasks submitted but not yet finished, and those not yet taken from a deque
+  std::atomic<int> pending_ {0};
+  std::atomic<int> queued_ {0};
+  std::atomic<unsigned> next_queue_ {0};
+
+  // the indexed run in progress, if any, and the next of its indices to hand out
+  std::mutex indexed_mutex_;
+  const std::function<void(int)>* indexed_fn_ = nullptr;
+  int indexed_count_ = 0;
+  int next_index_ = 0;
+
+  std::mutex wake_mutex_;
+  std::condition_variable wake_;
+  std::condition_variable done_;
+  bool stopping_ = false;
+
+  void run_worker (int index);
+
+  // runs one task, preferring an index of the indexed run, then the given worker's own deque (if any); returns false
+  // if there was nothing to run
+  bool run_one (int index);
+
+  // counts a task or index as finished, waking the waiters if it was the last
+  void finish_one ();
+};
+
+#endif // TASK_POOL_H
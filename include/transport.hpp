@@ -0,0 +1,22 @@
+#ifndef TRANSPORT_H
+#define TRANSPORT_H
+
+#include <cstddef>
+#include <vector>
+
+// one end of an unreliable datagram link to a peer: packets may arrive late, out of order or not at all, and it's up
+// to the protocol on top to cope
+class transport {
+public:
+  virtual ~transport () {}
+
+  virtual void send (const unsigned char* data, std::size_t size) = 0;
+
+  // takes the next packet that has arrived, returning false if there are none
+  virtual bool receive (std::vector<unsigned char>& packet) = 0;
+
+  // the link's clock, in seconds, which both ends are assumed to share (closely enough) for measuring latency
+  virtual double get_time () const = 0;
+};
+
+#endif // TRANSPORT_H
@@ -0,0 +1,39 @@
+#ifndef TRIPLE_BUFFER_H
+#define TRIPLE_BUFFER_H
+
+#include <atomic>
+
+// hands the latest of a stream of values from one writer thread to one reader thread without locks or copies: the
+// writer fills its back slot and publishes it (swapping it for the spare), the reader swaps the spare for its front
+// slot whenever a newer one's been published.  neither ever waits, and the reader always sees a complete value
+template<typename T>
+class triple_buffer {
+public:
+  // writer side: the slot to fill (which still holds whatever was last written there)
+  T& get_back () { return slots_[back_]; }
+
+  void publish () {
+    back_ = spare_.exchange(back_ | kFresh, std::memory_order_acq_rel) & kIndexMask;
+  }
+
+  // reader side: the most recently published value, which stays put until the next call
+  const T& acquire () {
+    if (spare_.load(std::memory_order_relaxed) & kFresh) {
+      front_ = spare_.exchange(front_, std::memory_order_acq_rel) & kIndexMask;
+    }
+    return slots_[front_];
+  }
+
+private:
+  static constexpr int kIndexMask = 3;
+  static constexpr int kFresh = 4;
+
+  T slots_[3];
+  int back_ = 0;
+  int front_ = 1;
+
+  // the slot neither side holds, flagged fresh when the writer has just published it
+  std::atomic<int> spare_ {2};
+};
+
+#endif // TRIPLE_BUFFER_H
@@ -0,0 +1,123 @@
+#ifndef VEC_ENV_H
+#define VEC_ENV_H
+
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include "logic.hpp"
+#include "step_clock.hpp"
+#include "task_pool.hpp"
+
+struct vec_env_config {
+  int rows = kDefaultFieldRows;
+  int cols = kDefaultFieldCols;
+
+  // an episode ends when either side has this many points, or after max_steps (zero for ten simulated minutes)
+  int points = 5;
+  long max_steps = 0;
+  float step_rate = kDefaultStepRate;
+
+  // the difficulty of the built-in computer the agent plays against
+  int opponent_depth = kDefaultPredictionDepth;
+
+  // balls beyond the first max_balls are left out of the observation
+  int max_balls = 8;
+
+  // the field is summarized as a grid of this many cells, each holding the fraction of its blocks still standing
+  int view_rows = 6;
+  int view_cols = 3;
+
+  // environments are stepped in batches of this many, one batch to a task
+  int batch_size = 64;
+};
+
+// many games stepped in lockstep for training an agent to play the top paddle (the computer's, kComputerBallIndex)
+// against the built-in computer on the bottom.  callers own the buffers, all flat arrays of floats, environment by
+// environment:
+//
+//   observations: get_observation_size() per environment; the agent's paddle, the other paddle, then max_balls
+//     balls as (x, y, vx, vy, present), zero beyond the last ball, then the block view row by row
+//   actions: kActionSize per environment; where to move the agent's paddle, and above 0.5 to launch its ball
+//   rewards: one per environment; +1 for each point won on the step, -1 for each lost
+//   dones: one per environment; 1 where the step ended an episode
+//
+// an environment whose episode ends starts the next straight away, so the observation it returns is the first of the
+// new episode.  nothing is allocated after construction
+//
+// each environment is a game of its own, and a batch ticks its games one after another: the balls stay in each
+// game's pool rather than being laid out across environments, and only the bookkeeping below is kept environment by
+// environment in flat arrays
+class vec_env {
+public:
+  static constexpr int kActionSize = 2;
+
+  // zero threads means one per hardware thread
+  explicit vec_env (int count, const vec_env_config& config = vec_env_config(), int thread_count = 0);
+
+  int get_count () const { return (int)games_.size(); }
+  int get_observation_size () const { return observation_size_; }
+
+  // starts every environment over with the seed given for it; later episodes' seeds follow from it
+  void reset (const unsigned* seeds, float* observations);
+
+  void step (const float* actions, float* observations, float* rewards, float* dones);
+
+  const game& get_game (int index) const { return *games_[index]; }
+  long get_episodes_finished () const;
+
+private:
+  // passes one environment's events back to the arrays below
+  class environment_listener : public game_listener {
+  public:
+    environment_listener (vec_env& env, int index) : env_(env), index_(index) {}
+
+    void clear_block (int row, int col) override;
+    void play_loss (int ball) override;
+
+  private:
+    vec_env& env_;
+    int index_;
+  };
+
+  vec_env_config config_;
+  float step_duration_;
+  int observation_size_;
+  task_pool pool_;
+
+  std::vector<environment_listener> listeners_;
+  std::vector<std::unique_ptr<game>> games_;
+
+  // per environment
+  std::vector<unsigned> seeds_;
+  std::vector<long> episodes_;
+  std::vector<long> episode_steps_;
+  std::vector<int> agent_scores_;
+  std::vector<int> opponent_scores_;
+  std::vector<float> step_rewards_;
+
+  // the view cell of each block (the same for every environment), each cell's block count, and the blocks standing
+  // in each environment's cells
+  std::vector<int> block_cells_;
+  std::vector<int> cell_sizes_;
+  std::vector<int> cell_counts_;
+
+  // the buffers of the call in progress, and what to do to each environment, for run_batch_ (made once, at
+  // construction, and handed to the pool by reference) to read
+  const unsigned* reset_seeds_ = nullptr;
+  const float* actions_ = nullptr;
+  float* observations_ = nullptr;
+  float* rewards_ = nullptr;
+  float* dones_ = nullptr;
+  void (vec_env::*batch_fn_) (int index) = nullptr;
+  std::function<void(int)> run_batch_;
+
+  void run_batches (void (vec_env::*fn) (int index));
+
+  void reset_environment (int index);
+  void step_environment (int index);
+  void start_episode (int index);
+  void write_observation (int index) const;
+};
+
+#endif // VEC_ENV_H
@@ -0,0 +1,83 @@
+#ifndef VEC_MATH_H
+#define VEC_MATH_H
+
+#include <cmath>
+
+#include "simd.hpp"
+
+constexpr double kPi = 3.14159265358979323846;
+
+// sine and cosine by their Taylor series, for working out constants at compile time; good to well beyond float
+// precision for angles up to a quarter turn or so
+constexpr double constexpr_sin (double x) {
+  auto term = x, sum = x;
+  for (auto n = 1; n < 12; ++n) {
+    term *= -x * x / ((2 * n) * (2 * n + 1));
+    sum += term;
+  }
+  return sum;
+}
+
+constexpr double constexpr_cos (double x) {
+  auto term = 1.0, sum = 1.0;
+  for (auto n = 1; n < 12; ++n) {
+    term *= -x * x / ((2 * n - 1) * (2 * n));
+    sum += term;
+  }
+  return sum;
+}
+
+struct vec2 {
+  float x, y;
+
+  vec2 (float x = 0.0f, float y = 0.0f) : x(x), y(y) {}
+
+  vec2 operator+ (const vec2& o) const { return vec2(x + o.x, y + o.y); }
+  vec2 operator- (const vec2& o) const { return vec2(x - o.x, y - o.y); }
+  vec2 operator- () const { return vec2(-x, -y); }
+  vec2 operator* (float s) const { return vec2(x * s, y * s); }
+  vec2 operator/ (float s) const { return *this * (1.0f / s); }
+
+  vec2& operator+= (const vec2& o) { x += o.x; y += o.y; return *this; }
+  vec2& operator-= (const vec2& o) { x -= o.x; y -= o.y; return *this; }
+  vec2& operator*= (float s) { x *= s; y *= s; return *this; }
+  vec2& operator/= (float s) { return *this *= (1.0f / s); }
+
+  float length_squared () const { return x * x + y * y; }
+
+  // no need for std::hypot's care over overflow with the magnitudes in play here, and a plain square root is a
+  // single instruction
+  float length () const { return std::sqrt(length_squared()); }
+  vec2 normalize () const { return *this / length(); }
+  vec2 ortho () const { return vec2(y, -x); }
+  float dot (const vec2& o) const { return x * o.x + y * o.y; }
+  vec2 reflect (const vec2& n) const { return n * dot(n) * 2.0f - *this; }
+};
+
+// four vec2s, one to a lane, with the same operations as vec2 (and, being made of the same IEEE operations, the same
+// results); loaded from and stored to separate x and y arrays, as the ball pool keeps them
+struct vec2x4 {
+  simd::float4 x, y;
+
+  static vec2x4 load (const float* x, const float* y) { return {simd::load(x), simd::load(y)}; }
+  void store (float* x, float* y) const {
+    simd::store(x, this->x);
+    simd::store(y, this->y);
+  }
+
+  vec2x4 operator+ (const vec2x4& o) const { return {x + o.x, y + o.y}; }
+  vec2x4 operator* (simd::float4 s) const { return {x * s, y * s}; }
+
+  simd::float4 length_squared () const { return x * x + y * y; }
+  vec2x4 normalize () const {
+    auto inverse = simd::splat(1.0f) / simd::sqrt(length_squared());
+    return {x * inverse, y * inverse};
+  }
+  simd::float4 dot (const vec2x4& o) const { return x * o.x + y * o.y; }
+  vec2x4 reflect (const vec2x4& n) const {
+    auto scale = dot(n) * simd::splat(2.0f);
+    return {n.x * scale - x, n.y * scale - y};
+  }
+};
+
+#endif // VEC_MATH_H
@@ -0,0 +1,67 @@
+#ifndef VOICE_MIXER_H
+#define VOICE_MIXER_H
+
+#include <vector>
+
+// decides what plays on a fixed set of voices (sources, to OpenAL) without touching the audio API itself.  sounds
+// requested over a frame are gathered, and any requested more than once are merged into a single, louder voice;
+// when every voice is busy, a sound takes over the one with the lowest priority (the oldest, among equals), or is
+// dropped if they all outrank it.  the frontend then makes the frame's audio calls in one go
+class voice_mixer {
+public:
+  // a voice to start playing the sound, stopping it first if it's been stolen from another
+  struct voice_start {
+    int voice;
+    int sound;
+    float gain;
+    bool stolen;
+  };
+
+  struct metrics {
+    long requests = 0;
+    long starts = 0;
+    long steals = 0;
+    long drops = 0;
+  };
+
+  explicit voice_mixer (int voice_count);
+
+  // registers a sound, returning its id: how long it plays for (in seconds), its priority (higher wins a voice) and
+  // its gain when requested once in a frame
+  int add_sound (double duration, int priority, float gain = 1.0f);
+
+  void request (int sound);
+
+  // assigns the requests since the last call to voices, as of the time given (in seconds)
+  const std::vector<voice_start>& mix (double time);
+
+  int get_voice_count () const { return (int)voices_.size(); }
+  const metrics& get_metrics () const { return metrics_; }
+
+private:
+  struct sound {
+    double duration;
+    int priority;
+    float gain;
+  };
+
+  struct voice {
+    int priority = 0;
+    double start_time = 0.0;
+    double end_time = 0.0;
+  };
+
+  std::vector<sound> sounds_;
+  std::vector<voice> voices_;
+
+  // how many times each sound has been requested this frame, and which have (in the order they first were)
+  std::vector<int> request_counts_;
+  std::vector<int> requested_sounds_;
+
+  std::vector<voice_start> starts_;
+  metrics metrics_;
+
+  int find_voice (int priority, double time) const;
+};
+
+#endif // VOICE_MIXER_H
@@ -0,0 +1,9 @@
+precision mediump float;
+
+uniform sampler2D image;
+
+varying vec2 tex_coord;
+
+void main (void) {
+  gl_FragColor = texture2D(image, tex_coord);
+}
\ No newline at end of file
@@ -2,7 +2,7 @@ precision mediump float;
 
 uniform highp float aspect;
 
-uniform sampler2D texture;
+uniform sampler2D image;
 uniform float field_cols;
 uniform float field_rows;
 
@@ -26,7 +26,7 @@ void main (void) {
 
   const float kAmbient = 0.35;
   const vec3 kLightVector = vec3(0.57735, 0.57735, 0.57735);
-  vec4 color = texture2D(texture, tex_coord);
+  vec4 color = texture2D(image, tex_coord);
   gl_FragColor = vec4(
       color.rgb * (kAmbient + (1.0 - kAmbient) * max(dot(normal, kLightVector), 0.0)),
       color.a);
@@ -1,6 +1,6 @@
 precision mediump float;
 
-uniform highp float aspect;
+varying highp float aspect;
 
 varying vec2 unit_coord;
 
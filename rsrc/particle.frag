@@ -0,0 +1,8 @@
+precision mediump float;
+
+varying vec2 unit_coord;
+varying vec4 particle_color;
+
+void main (void) {
+  gl_FragColor = vec4(particle_color.rgb, particle_color.a * step(dot(unit_coord, unit_coord), 1.0));
+}
\ No newline at end of file
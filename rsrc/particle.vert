@@ -0,0 +1,38 @@
+uniform vec2 scale;
+uniform float time;
+
+// the corner of the particle's quad, and the particle's index within its burst as a fraction of the burst's size
+attribute vec3 vertex;
+
+// where (in field coordinates) and when the burst started, and its colour
+attribute vec3 burst;
+attribute vec3 color;
+
+varying vec2 unit_coord;
+varying vec4 particle_color;
+
+// kParticleLifetime in app.cpp
+const float kLifetime = 0.75;
+const float kSpread = 0.12;
+const float kSize = 0.018;
+
+float random (float seed) {
+  return fract(sin(seed) * 43758.5453);
+}
+
+void main (void) {
+  float age = time - burst.z;
+  float life = clamp(age / kLifetime, 0.0, 1.0);
+
+  // each particle flies off on a heading and at a speed of its own, slowing as it goes
+  float variation = random(vertex.z * 12.9898 + burst.z * 78.233);
+  float angle = (vertex.z + variation * 0.1) * 6.2831853;
+  float travel = kSpread * (0.4 + 0.6 * variation) * (1.0 - (1.0 - life) * (1.0 - life));
+  vec2 position = burst.xy + vec2(cos(angle), sin(angle)) * travel;
+
+  // bursts not yet started or already over shrink to nothing, so they cost no fragments
+  float size = kSize * (1.0 - life) * step(0.0, age) * step(age, kLifetime);
+  unit_coord = vertex.xy * 2.0;
+  particle_color = vec4(color, 1.0 - life);
+  gl_Position = vec4((position + vertex.xy * size) * scale, 0.0, 1.0);
+}
\ No newline at end of file
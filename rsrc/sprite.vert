@@ -0,0 +1,15 @@
+uniform vec2 scale;
+
+attribute vec2 vertex;
+attribute vec4 sprite;
+
+varying vec2 tex_coord;
+varying vec2 unit_coord;
+varying highp float aspect;
+
+void main (void) {
+  tex_coord = vertex + vec2(0.5, 0.5);
+  aspect = sprite.z / sprite.w;
+  unit_coord = vec2(vertex.x * 2.0 * aspect, vertex.y * 2.0);
+  gl_Position = vec4((sprite.xy + vertex * sprite.zw) * scale, 0.0, 1.0);
+}
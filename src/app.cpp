@@ -1,21 +1,39 @@
+#include <algorithm>
+#include <cctype>
 #include <chrono>
 #include <cmath>
 #include <cstdint>
 #include <cstdlib>
-#include <fstream>
+#include <cstring>
 #include <iostream>
 #include <random>
+#include <sstream>
 #include <string>
 #include <vector>
 
 #include <emscripten.h>
 #include <emscripten/html5.h>
 
+#define GL_GLEXT_PROTOTYPES
+#include <GLES3/gl3.h>
+#include <GLES2/gl2ext.h>
+
 #include <AL/alc.h>
 #include <AL/al.h>
 
 #include "app.hpp"
+#include "gl_state.hpp"
 #include "logic.hpp"
+#include "profiler.hpp"
+#include "replay.hpp"
+#include "resolution_controller.hpp"
+#include "shader_sources.hpp"
+#include "step_clock.hpp"
+#include "voice_mixer.hpp"
+
+#ifdef SIM_THREAD
+#include "sim_worker.hpp"
+#endif
 
 namespace {
 
@@ -26,19 +44,266 @@ double canvas_offset = 0.0;
 float device_pixel_ratio;
 GLuint buffer;
 GLuint quad_shader;
+GLuint sprite_shader;
+GLuint particle_shader;
 GLuint block_texture;
 
+// core on WebGL 2, an extension on WebGL 1
+bool instanced_arrays = false;
+
+// on a WebGL 2 context the shaders are translated to GLSL ES 3.00 (see translate_shader), attribute setup lives in
+// vertex arrays, and the uniforms every program shares are read from a buffer written once a frame rather than set
+// program by program
+bool webgl2 = false;
+GLuint frame_uniform_buffer;
+constexpr GLuint kFrameUniformBinding = 0;
+
+// the shared uniforms, which take the place of the shaders' own declarations of them; in std140 layout, time is at
+// offset zero and scale at eight
+const char* const kFrameUniforms[] {"time", "scale"};
+constexpr char kFrameUniformBlock[] = "layout(std140) uniform frame_uniforms{highp float time;highp vec2 scale;};\n";
+constexpr GLsizeiptr kFrameUniformSize = 4 * sizeof(GLfloat);
+
+// with KHR_parallel_shader_compile, programs link in the background and we poll them from the main loop; without
+// it, the first poll blocks until they're done
+bool parallel_shader_compile = false;
+bool programs_ready = false;
+bool first_frame_drawn = false;
+
+std::unique_ptr<sprite_batch> paddle_batch;
+std::unique_ptr<sprite_batch> ball_batch;
+
+// a ring of burst records, each animating kParticlesPerBurst particles for kParticleLifetime seconds (as in
+// particle.vert); once it's full, a new burst replaces the oldest, long since over at any plausible rate of clearing
+constexpr int kParticlesPerBurst = 16;
+constexpr int kMaxBursts = 128;
+constexpr float kParticleLifetime = 0.75f;
+
+// each particle is two triangles, each vertex its quad corner and the particle's index as a fraction; a record is
+// the burst's position and start time, then its colour
+constexpr int kParticleVertices = kParticlesPerBurst * 6;
+constexpr int kCornerSize = 3;
+constexpr int kRecordSize = 6;
+std::unique_ptr<particle_system> particles;
+
+// the lit wall of blocks, redrawn only when it changes, and the scene behind the paddles and balls (the backdrop with
+// the wall over it), redrawn when the wall changes or the backdrop animation ticks; the canvas gets the scene with a
+// single blit each frame
+std::unique_ptr<render_layer> wall_layer;
+std::unique_ptr<render_layer> scene_layer;
+bool wall_dirty = true;
+
+// how often the backdrop animation advances (zero to freeze it); it moves slowly, so a low rate is hard to tell apart
+// from the full frame rate
+constexpr float kDefaultBackdropRate = 15.0f;
+float backdrop_rate = kDefaultBackdropRate;
+double next_backdrop_time = 0.0;
+
+// the frame's draws, queued and then sorted by program before they go to GL
+command_buffer frame_commands;
+gl_render_backend gl_backend;
+
+// everything is drawn at a fraction of the canvas resolution chosen from the frame times, then scaled up to fill it
+resolution_controller resolution;
+std::unique_ptr<render_layer> frame_layer;
+
+// RGB per block, computed once
+std::vector<unsigned char> block_colors;
+
+// a copy of the block texture, from which the blocks changed over a frame are uploaded together
+std::vector<unsigned char> block_texture_data;
+std::vector<unsigned char> block_upload_data;
+
+// the blocks changed since the last frame, queued for upload with its draws
+block_changes changed_blocks;
+
 ALCdevice* audio_device = nullptr;
 ALCcontext* audio_context;
-ALuint launch_buffer;
-ALuint bounce_buffer;
-ALuint loss_buffer;
-ALuint ball_sources[2];
+
+constexpr double kRandomBufferDuration = 1 / 250.0;
+constexpr double kRampBufferDuration = 1 / 10.0;
+
+// events ask the mixer for sounds, and once a frame it merges them and hands out the voices, whose audio calls are
+// then made together; losing a ball matters most, then launching one, and bounces give way to either
+constexpr int kVoiceCount = 8;
+voice_mixer mixer(kVoiceCount);
+const int launch_sound = mixer.add_sound(kRampBufferDuration, 1);
+const int bounce_sound = mixer.add_sound(kRandomBufferDuration, 0);
+const int loss_sound = mixer.add_sound(kRampBufferDuration, 2);
+ALuint sound_buffers[3];
+ALuint voice_sources[kVoiceCount];
 
 double last_time;
+step_clock sim_clock;
+
+// the player's paddle as the pointer left it, which the next step takes up (and which is drawn straight away), and
+// whether a launch has been asked for since the last step
+float player_input = 0.0f;
+bool release_requested = false;
+
+#ifdef SIM_THREAD
+
+// the simulation runs on a worker thread; each frame draws the latest step it has published and plays the events it
+// has raised since the last frame.  a replay is asked for and downloaded once the worker has encoded it
+std::unique_ptr<sim_worker> worker;
+bool replay_pending = false;
+
+#else
+
+// the session so far, for saving as a replay; input is applied at step boundaries, as the recorder sees it, so that
+// a replay steps through exactly the same states
+replay_recorder recorder;
+
+// the shared game as of the last step, for drawing
+sim_frame shared_frame;
+
+#endif
+
+// defined with the audio below
+void flush_audio ();
+#ifdef SIM_THREAD
+void handle_sim_event (const sim_event& event);
+#endif
+
+long frames_since_gl_counts_reset = 0;
 
 constexpr double kSecondsPerMillisecond = 1.0 / 1000.0;
 
+// hands the data to the browser as a file download
+void download_file (const char* name, const char* type, const void* data, std::size_t size) {
+  EM_ASM({
+    var blob = new Blob([HEAPU8.slice($2, $2 + $3)], {type: UTF8ToString($1)});
+    var link = document.createElement('a');
+    link.href = URL.createObjectURL(blob);
+    link.download = UTF8ToString($0);
+    link.click();
+    URL.revokeObjectURL(link.href);
+  }, name, type, data, size);
+}
+
+#ifdef PROFILER_ENABLED
+
+// the overlay lists the percentiles of each zone and counter over the recent frames, refreshed a couple of times a
+// second rather than every frame so that it's readable (and cheap)
+constexpr double kProfilerOverlayInterval = 0.5;
+bool profiler_overlay_visible = false;
+double next_profiler_overlay_time = 0.0;
+
+void set_profiler_overlay_visible (bool visible) {
+  profiler_overlay_visible = visible;
+  next_profiler_overlay_time = 0.0;
+  EM_ASM({
+    var overlay = document.getElementById('profiler');
+    if (!overlay) {
+      overlay = document.createElement('pre');
+      overlay.id = 'profiler';
+      overlay.style.cssText = 'position: fixed; left: 0; top: 0; margin: 0; padding: 4px; pointer-events: none; ' +
+        'font: 11px monospace; color: #fff; background: rgba(0, 0, 0, 0.6); z-index: 1';
+      document.body.appendChild(overlay);
+    }
+    overlay.style.display = $0 ? 'block' : 'none';
+  }, visible);
+}
+
+void update_profiler_overlay () {
+  auto time = last_time * kSecondsPerMillisecond;
+  if (!profiler_overlay_visible || time < next_profiler_overlay_time) return;
+  next_profiler_overlay_time = time + kProfilerOverlayInterval;
+
+  std::ostringstream text;
+  text.setf(std::ios::fixed);
+  text.precision(2);
+  text << "                        p50      p90      p99\n";
+  for (auto& stats : profiler::get_frame_stats()) {
+    // the worker's zones (the simulation's, with SIM_THREAD) are marked with its thread id
+    text.width(20);
+    text << std::left << (stats.thread ? "#" + std::to_string(stats.thread) + " " + stats.name : stats.name) <<
+      std::right;
+    for (auto value : {stats.p50, stats.p90, stats.p99}) {
+      text.width(9);
+      text << value;
+    }
+    text << (stats.counter ? "\n" : " ms\n");
+  }
+  EM_ASM({ document.getElementById('profiler').textContent = UTF8ToString($0); }, text.str().c_str());
+}
+
+void save_trace () {
+  std::ostringstream trace;
+  profiler::write_trace(trace);
+  auto text = trace.str();
+  download_file("breakthrough-trace.json", "application/json", text.data(), text.size());
+}
+
+#endif
+
+#ifdef SIM_THREAD
+
+void update_simulation () {
+  auto& frame = worker->acquire_frame();
+
+  // every event from the steps up to the frame has been queued by the time it's published
+  worker->drain_events(handle_sim_event);
+  worker->send_input(player_input, release_requested);
+  release_requested = false;
+
+  auto alpha = std::min(std::max((sim_worker::now() - frame.time) / worker->get_step_duration(), 0.0), 1.0);
+  draw_frame(frame, (float)alpha);
+
+  if (replay_pending) {
+    auto data = worker->take_replay();
+    if (data) {
+      download_file("breakthrough.replay", "application/octet-stream", data->data(), data->size());
+      replay_pending = false;
+    }
+  }
+}
+
+#else
+
+void step_game () {
+  set_player_position(recorder.record_step(player_input, release_requested));
+  if (release_requested) maybe_release_player_ball();
+  release_requested = false;
+  tick(sim_clock.get_step_duration());
+}
+
+void update_simulation (double dt) {
+  for (auto steps = sim_clock.advance(dt); steps > 0; --steps) step_game();
+  shared_frame.capture(get_shared_game(), 0, 0.0);
+  draw_frame(shared_frame, sim_clock.get_alpha());
+}
+
+#endif
+
+bool poll_programs () {
+  auto ready = true;
+  for (auto program : {
+      backdrop_program.get(), paddle_program.get(), ball_program.get(), blocks_program.get(), blit_program.get(),
+      particle_program.get()}) {
+    // keep polling the rest, so that those that are done get their uniforms gathered
+    if (!program->poll_link()) ready = false;
+  }
+  return ready;
+}
+
+// the setup that needs linked programs
+void finish_context () {
+  for (auto program : {paddle_program.get(), ball_program.get(), particle_program.get()}) {
+    program->set_uniform("scale", 2.0f, kAspect * 2.0f);
+  }
+  paddle_batch.reset(new sprite_batch(*paddle_program, instanced_arrays));
+  ball_batch.reset(new sprite_batch(*ball_program, instanced_arrays));
+  particles.reset(new particle_system(*particle_program, instanced_arrays));
+
+  blocks_program->set_uniform("image", 0);
+  blit_program->set_uniform("image", 0);
+  reset_blocks();
+
+  programs_ready = true;
+  if (!first_frame_drawn) std::cout << "shaders ready at " << emscripten_performance_now() << " ms" << std::endl;
+}
+
 EM_BOOL main_loop (double time, void* user_data) {  
   double dt = (time - last_time) * kSecondsPerMillisecond;
   last_time = time;
@@ -47,49 +312,200 @@ EM_BOOL main_loop (double time, void* user_data) {
 
   emscripten_webgl_make_context_current(webgl_context);
 
-  tick(dt);
+  if (!programs_ready) {
+    if (!poll_programs()) return true;
+    finish_context();
+  }
+
+  {
+    PROFILE_ZONE("main_loop");
+
+    // WebGL offers no GPU timing to speak of, but a GPU-bound frame shows up in the interval between frames all the
+    // same
+    resolution.update(dt);
+
+    ++frames_since_gl_counts_reset;
+#ifdef SIM_THREAD
+    update_simulation();
+#else
+    update_simulation(dt);
+#endif
+    flush_audio();
+  }
+  PROFILE_END_FRAME();
+#ifdef PROFILER_ENABLED
+  update_profiler_overlay();
+#endif
+
+  if (!first_frame_drawn) {
+    // performance.now() counts from the start of navigation, so this covers loading the module as well
+    std::cout << "first frame drawn at " << emscripten_performance_now() << " ms" << std::endl;
+    first_frame_drawn = true;
+  }
 
   return true;
 }
 
-GLuint load_shader (GLenum shader_type, const char* filename) {
+bool is_identifier_char (char c) {
+  return std::isalnum((unsigned char)c) || c == '_';
+}
+
+// rewrites an embedded GLSL ES 1.00 shader as GLSL ES 3.00, so that one set of sources serves both contexts: the
+// storage qualifiers and the texture lookup take their new names, the fragment shader declares its output, and
+// declarations of the frame's uniforms give way to the frame's uniform block
+std::string translate_shader (GLenum shader_type, const char* text) {
+  auto fragment = (shader_type == GL_FRAGMENT_SHADER);
+  auto uses_frame_uniforms = false;
+  std::string body;
+  for (auto it = text; *it; ) {
+    if (!is_identifier_char(*it)) {
+      body += *it++;
+      continue;
+    }
+    auto end = it;
+    while (is_identifier_char(*end)) ++end;
+    std::string word(it, end);
+    if (word == "uniform") {
+      // the shaders declare a uniform per statement, so the statement's last word is its name
+      auto statement_end = std::strchr(end, ';');
+      std::string statement(it, statement_end);
+      auto name = statement.substr(statement.find_last_of(' ') + 1);
+      if (std::find(std::begin(kFrameUniforms), std::end(kFrameUniforms), name) != std::end(kFrameUniforms)) {
+        uses_frame_uniforms = true;
+        it = statement_end + 1;
+        continue;
+      }
+    }
+    if (word == "attribute") word = "in";
+    else if (word == "varying") word = fragment ? "in" : "out";
+    else if (word == "texture2D") word = "texture";
+    else if (word == "gl_FragColor") word = "frag_color";
+    body += word;
+    it = end;
+  }
+
+  std::string header = "#version 300 es\n";
+  if (fragment) header += "out mediump vec4 frag_color;\n";
+  if (uses_frame_uniforms) header += kFrameUniformBlock;
+  return header + body;
+}
+
+// returns zero if there's no shader by that name, which leaves any program using it to fail to link
+GLuint compile_shader (GLenum shader_type, const char* name) {
+  auto source = std::find_if(std::begin(kShaderSources), std::end(kShaderSources), [=](const shader_source& source) {
+    return std::strcmp(source.name, name) == 0;
+  });
+  if (source == std::end(kShaderSources)) {
+    std::cerr << "no such shader: " << name << std::endl;
+    return 0;
+  }
   GLuint shader = glCreateShader(shader_type);
-  std::vector<std::string> lines;
-  std::vector<const GLchar*> strings;
-  std::vector<GLint> lengths;
-  std::ifstream in(filename);
-  while (in.good()) {
-    lines.push_back(std::string());
-    std::getline(in, lines.back());
-    lengths.push_back(lines.back().length());
-    strings.push_back(lines.back().data());
-  }
-  glShaderSource(shader, strings.size(), strings.data(), lengths.data());
+  auto text = source->text;
+  std::string translated;
+  if (webgl2) {
+    translated = translate_shader(shader_type, text);
+    text = translated.c_str();
+  }
+  glShaderSource(shader, 1, &text, nullptr);
   glCompileShader(shader);
   return shader;
 }
 
+// creates a vertex array and binds it, ready for its attributes to be set up
+GLuint create_vertex_array () {
+  GLuint vertex_array;
+  glGenVertexArrays(1, &vertex_array);
+  gl_cache.bind_vertex_array(vertex_array);
+  return vertex_array;
+}
+
+// writes the uniforms shared by every program for the frame
+void update_frame_uniforms (GLfloat time) {
+  const GLfloat data[] {time, 0.0f, 2.0f, kAspect * 2.0f};
+  glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(data), data);
+  PROFILE_COUNT("buffer uploads", 1);
+}
+
+void init_block_colors (int rows, int cols) {
+  block_colors.resize(rows * cols * 3);
+  auto it = block_colors.begin();
+  auto write_rgb = [&](float r, float g, float b) {
+    *it++ = (unsigned char)(255.0f * r);
+    *it++ = (unsigned char)(255.0f * g);
+    *it++ = (unsigned char)(255.0f * b);
+  };
+  for (auto row = 0; row < rows; ++row) {
+    for (auto col = 0; col < cols; ++col) {
+      auto hue = 5.0f * (row + col + 1.0f) / (cols + rows);
+      auto range = (int)hue;
+      auto level = hue - range;
+      switch (range) {
+        case 0: write_rgb(1.0f, level, 0.0f); break;
+        case 1: write_rgb(1.0f - level, 1.0f, 0.0f); break;
+        case 2: write_rgb(0.0f, 1.0f, level); break;
+        case 3: write_rgb(0.0f, 1.0f - level, 1.0f); break;
+        case 4: write_rgb(level, 0.0f, 1.0f); break;
+      }
+    }
+  }
+}
+
+// uploads a rectangle of the block texture from the copy, packed into a staging buffer if it doesn't span whole rows
+// (GLES2 has no unpack row length)
+void upload_blocks (int first_col, int first_row, int width, int height) {
+  PROFILE_ZONE("upload_blocks");
+  auto row_size = get_field_cols() * 4;
+  const unsigned char* data = &block_texture_data[first_row * row_size + first_col * 4];
+  if (width * 4 < row_size && height > 1) {
+    block_upload_data.resize(width * height * 4);
+    for (auto offset = 0; offset < height; ++offset) {
+      auto source = data + offset * row_size;
+      std::copy(source, source + width * 4, block_upload_data.begin() + offset * width * 4);
+    }
+    data = block_upload_data.data();
+  }
+  glTexSubImage2D(GL_TEXTURE_2D, 0, first_col, first_row, width, height, GL_RGBA, GL_UNSIGNED_BYTE, data);
+  PROFILE_COUNT("texture uploads", 1);
+}
+
 void init_context () {
   emscripten_webgl_make_context_current(webgl_context);
+  gl_cache.reset();
 
   glGenBuffers(1, &buffer);
-  glBindBuffer(GL_ARRAY_BUFFER, buffer);
+  gl_cache.bind_buffer(GL_ARRAY_BUFFER, buffer);
   const GLfloat kBufferData[] {-0.5f, -0.5f, 0.5f, -0.5f, 0.5f, 0.5f, -0.5f, 0.5f};
   glBufferData(GL_ARRAY_BUFFER, sizeof(kBufferData), kBufferData, GL_STATIC_DRAW);
 
-  quad_shader = load_shader(GL_VERTEX_SHADER, "rsrc/quad.vert");
-  backdrop_program.reset(new shader_program("rsrc/backdrop.frag"));
-  paddle_program.reset(new shader_program("rsrc/paddle.frag"));
-  ball_program.reset(new shader_program("rsrc/ball.frag"));
+  instanced_arrays = webgl2 || emscripten_webgl_enable_extension(webgl_context, "ANGLE_instanced_arrays");
+  parallel_shader_compile = emscripten_webgl_enable_extension(webgl_context, "KHR_parallel_shader_compile");
+
+  if (webgl2) {
+    // binding the base binds the generic target too, which nothing else uses, so it stays bound for the updates
+    glGenBuffers(1, &frame_uniform_buffer);
+    glBindBufferBase(GL_UNIFORM_BUFFER, kFrameUniformBinding, frame_uniform_buffer);
+    glBufferData(GL_UNIFORM_BUFFER, kFrameUniformSize, nullptr, GL_DYNAMIC_DRAW);
+  }
 
-  blocks_program.reset(new shader_program("rsrc/blocks.frag"));
-  blocks_program->set_uniform("texture", 0);
-  blocks_program->set_uniform("field_rows", (float)kFieldRows);
-  blocks_program->set_uniform("field_cols", (float)kFieldCols);
+  // start everything compiling and linking now; the rest of the setup waits until the programs are ready
+  programs_ready = false;
+  quad_shader = compile_shader(GL_VERTEX_SHADER, "quad.vert");
+  sprite_shader = compile_shader(GL_VERTEX_SHADER, "sprite.vert");
+  backdrop_program.reset(new shader_program("backdrop.frag"));
+  paddle_program.reset(new shader_program(sprite_shader, "paddle.frag"));
+  ball_program.reset(new shader_program(sprite_shader, "ball.frag"));
+  blocks_program.reset(new shader_program("blocks.frag"));
+  blit_program.reset(new shader_program("blit.frag"));
+  particle_shader = compile_shader(GL_VERTEX_SHADER, "particle.vert");
+  particle_program.reset(new shader_program(particle_shader, "particle.frag"));
+
+  // sized on first use
+  wall_layer.reset(new render_layer());
+  scene_layer.reset(new render_layer());
+  frame_layer.reset(new render_layer(GL_LINEAR));
 
   glGenTextures(1, &block_texture);
-  glBindTexture(GL_TEXTURE_2D, block_texture);
-  reset_blocks();
+  gl_cache.bind_texture(block_texture);
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
@@ -109,9 +525,8 @@ ALuint create_random_buffer () {
   ALuint buffer;
   alGenBuffers(1, &buffer);
   
-  constexpr float kDuration = 1 / 250.0f;
   constexpr int kAmplitude = 8192;
-  std::int16_t buffer_data[(int)(kBufferFrequency * kDuration)];
+  std::int16_t buffer_data[(int)(kBufferFrequency * kRandomBufferDuration)];
   static std::default_random_engine engine(std::chrono::system_clock::now().time_since_epoch().count());
   std::uniform_int_distribution<std::int16_t> distribution(-kAmplitude, kAmplitude);
   for (auto& sample : buffer_data) sample = distribution(engine);
@@ -125,11 +540,10 @@ ALuint create_ramp_buffer (float start, float end) {
   ALuint buffer;
   alGenBuffers(1, &buffer);
 
-  constexpr float kDuration = 1 / 10.0f;
   constexpr float kAmplitude = 4096.0f;
-  std::int16_t buffer_data[(int)(kBufferFrequency * kDuration)];
+  std::int16_t buffer_data[(int)(kBufferFrequency * kRampBufferDuration)];
   auto frequency = start;
-  auto df = (end - start) / (kDuration * kBufferFrequency);
+  auto df = (end - start) / (float)(kRampBufferDuration * kBufferFrequency);
   auto phase = 0.0f;
   for (auto& sample : buffer_data) {
     sample = (std::int16_t)(kAmplitude * std::sin(phase));
@@ -148,24 +562,64 @@ void maybe_init_audio () {
   audio_context = alcCreateContext(audio_device, nullptr);
   alcMakeContextCurrent(audio_context);
 
-  launch_buffer = create_ramp_buffer(200, 2000);
-  bounce_buffer = create_random_buffer();
-  loss_buffer = create_ramp_buffer(2000, 200);
+  sound_buffers[launch_sound] = create_ramp_buffer(200, 2000);
+  sound_buffers[bounce_sound] = create_random_buffer();
+  sound_buffers[loss_sound] = create_ramp_buffer(2000, 200);
+
+  alGenSources(kVoiceCount, voice_sources);
+}
 
-  alGenSources(sizeof(ball_sources) / sizeof(ball_sources[0]), ball_sources);
+void request_sound (int sound) {
+  if (audio_device) mixer.request(sound);
 }
 
-void play_audio_buffer (int ball, ALuint buffer) {
+// stops the voices starting this frame (they may be stolen, or only just finished), points each at its sound and
+// starts them all again
+void flush_audio () {
   if (!audio_device) return;
+  auto& starts = mixer.mix(last_time * kSecondsPerMillisecond);
+  if (starts.empty()) return;
+  PROFILE_COUNT("voices started", starts.size());
 
-  auto source = ball_sources[ball];
+  ALuint sources[kVoiceCount];
+  auto count = 0;
+  for (auto& start : starts) sources[count++] = voice_sources[start.voice];
 
   alcMakeContextCurrent(audio_context);
-  alSourcei(source, AL_BUFFER, buffer);
-  alSourceRewind(source);
-  alSourcePlay(source);
+  alSourceStopv(count, sources);
+  for (auto& start : starts) {
+    auto source = voice_sources[start.voice];
+    alSourcei(source, AL_BUFFER, sound_buffers[start.sound]);
+    alSourcef(source, AL_GAIN, start.gain);
+  }
+  alSourcePlayv(count, sources);
+}
+
+#ifdef SIM_THREAD
+
+void handle_sim_event (const sim_event& event) {
+  switch (event.kind) {
+    case sim_event::kClearBlock: clear_block(event.a, event.b); break;
+    case sim_event::kLaunch: request_sound(launch_sound); break;
+    case sim_event::kBounce: request_sound(bounce_sound); break;
+    case sim_event::kLoss: request_sound(loss_sound); break;
+  }
 }
 
+#else
+
+// hands the shared game's events to the wall and the mixer
+class frontend_listener : public game_listener {
+public:
+  void clear_block (int row, int col) override { ::clear_block(row, col); }
+
+  void play_launch (int) override { request_sound(launch_sound); }
+  void play_bounce (int) override { request_sound(bounce_sound); }
+  void play_loss (int) override { request_sound(loss_sound); }
+} frontend;
+
+#endif
+
 EM_BOOL on_canvas_resized (int event_type, const void* reserved, void* user_data) {
   emscripten_get_canvas_element_size("canvas", &canvas_width, &canvas_height);
 
@@ -180,8 +634,12 @@ EM_BOOL on_canvas_resized (int event_type, const void* reserved, void* user_data
   return true;
 }
 
+void set_player_input (float position) {
+  player_input = std::min(std::max(position, -kMaxPaddleX), kMaxPaddleX);
+}
+
 void update_player_position (int target_x) {
-  set_player_position((target_x * device_pixel_ratio - canvas_offset) / canvas_width - 0.5f);
+  set_player_input((target_x * device_pixel_ratio - canvas_offset) / canvas_width - 0.5f);
 }
 
 EM_BOOL on_mouse_move (int event_type, const EmscriptenMouseEvent* mouse_event, void* user_data) {
@@ -189,7 +647,7 @@ EM_BOOL on_mouse_move (int event_type, const EmscriptenMouseEvent* mouse_event,
   emscripten_get_pointerlock_status(&pointerlock_event);
 
   if (pointerlock_event.isActive) {
-    set_player_position(get_player_position() + mouse_event->movementX * device_pixel_ratio / canvas_width);
+    set_player_input(player_input + mouse_event->movementX * device_pixel_ratio / canvas_width);
   } else {
     update_player_position(mouse_event->targetX);
   }
@@ -204,7 +662,7 @@ EM_BOOL on_mouse_down (int event_type, const EmscriptenMouseEvent* mouse_event,
   if (!pointerlock_event.isActive) emscripten_request_pointerlock("canvas", false);
 
   maybe_init_audio();
-  maybe_release_player_ball();
+  release_requested = true;
 
   return true;
 }
@@ -212,7 +670,7 @@ EM_BOOL on_mouse_down (int event_type, const EmscriptenMouseEvent* mouse_event,
 EM_BOOL on_touch_start (int event_type, const EmscriptenTouchEvent* touch_event, void* user_data) {
   maybe_init_audio();
   update_player_position(touch_event->touches[0].targetX);
-  maybe_release_player_ball();
+  release_requested = true;
   return true;
 }
 
@@ -221,6 +679,24 @@ EM_BOOL on_touch_move (int event_type, const EmscriptenTouchEvent* touch_event,
   return true;
 }
 
+#ifdef PROFILER_ENABLED
+
+// P toggles the overlay and T saves a trace
+EM_BOOL on_key_down (int event_type, const EmscriptenKeyboardEvent* key_event, void* user_data) {
+  if (key_event->repeat || key_event->ctrlKey || key_event->altKey || key_event->metaKey) return false;
+  if (!std::strcmp(key_event->code, "KeyP")) {
+    set_profiler_overlay_visible(!profiler_overlay_visible);
+    return true;
+  }
+  if (!std::strcmp(key_event->code, "KeyT")) {
+    save_trace();
+    return true;
+  }
+  return false;
+}
+
+#endif
+
 EM_BOOL on_webglcontext_lost (int event_type, const void* reserved, void* user_data) {
   webgl_context_lost = true;
   return true;
@@ -232,21 +708,78 @@ EM_BOOL on_webglcontext_restored (int event_type, const void* reserved, void* us
   return true;
 }
 
+// the average milliseconds fn spends submitting a frame's draws, with the GPU's work finished between frames so that
+// one frame's backlog doesn't hold up the next
+template<typename F>
+double time_submission (int frames, F fn) {
+  auto total = 0.0;
+  for (auto frame = 0; frame < frames; ++frame) {
+    auto start = emscripten_get_now();
+    fn();
+    total += emscripten_get_now() - start;
+    glFinish();
+  }
+  return total / frames;
+}
+
+// draws a grid of small quads into an offscreen layer, first one call at a time (alternating between two programs,
+// as a frame's passes do) and then as a single sprite batch, and reports the CPU cost of submitting each
+void benchmark_draw_submission (int quads, int frames) {
+  if (!programs_ready || webgl_context_lost || quads <= 0 || frames <= 0) {
+    std::cout << "nothing to benchmark yet" << std::endl;
+    return;
+  }
+  emscripten_webgl_make_context_current(webgl_context);
+
+  constexpr int kTargetSize = 64;
+  render_layer target;
+  target.set_size(kTargetSize, kTargetSize);
+  target.begin();
+  glViewport(0, 0, kTargetSize, kTargetSize);
+  gl_cache.bind_texture(block_texture);
+
+  auto columns = std::max((int)std::sqrt((float)quads), 1);
+  auto size = 1.0f / columns;
+  auto get_x = [&](int quad) { return (quad % columns + 0.5f) * size - 0.5f; };
+  auto get_y = [&](int quad) { return (quad / columns + 0.5f) * size - 0.5f; };
+  auto separate = time_submission(frames, [&]() {
+    for (auto quad = 0; quad < quads; ++quad) {
+      auto& program = (quad % 2) ? blit_program : backdrop_program;
+      program->draw_quad(get_x(quad), get_y(quad), size, size);
+    }
+  });
+  auto batched = time_submission(frames, [&]() {
+    for (auto quad = 0; quad < quads; ++quad) ball_batch->add(get_x(quad), get_y(quad), size, size);
+    ball_batch->flush();
+  });
+  target.end();
+  glViewport(0, 0, canvas_width, canvas_height);
+
+  std::cout << "WebGL " << (webgl2 ? 2 : 1) << ", " << quads << " quads over " << frames << " frames: " <<
+    separate * 1000.0 / quads << " us per separate draw, " << batched * 1000.0 / quads << " us per batched quad (" <<
+    separate << " and " << batched << " ms per frame)" << std::endl;
+}
+
 void cleanup () {
+#ifdef SIM_THREAD
+  worker->stop();
+#endif
+
   if (webgl_context_lost) return;
 
   emscripten_webgl_make_context_current(webgl_context);
 
   glDeleteBuffers(1, &buffer);
+  if (webgl2) glDeleteBuffers(1, &frame_uniform_buffer);
   glDeleteShader(quad_shader);
+  glDeleteShader(sprite_shader);
+  glDeleteShader(particle_shader);
   glDeleteTextures(1, &block_texture);
 
   if (audio_device) {
     alcMakeContextCurrent(audio_context);
-    alDeleteBuffers(1, &launch_buffer);
-    alDeleteBuffers(1, &bounce_buffer);
-    alDeleteBuffers(1, &loss_buffer);
-    alDeleteSources(sizeof(ball_sources) / sizeof(ball_sources[0]), ball_sources);
+    alDeleteBuffers(sizeof(sound_buffers) / sizeof(sound_buffers[0]), sound_buffers);
+    alDeleteSources(kVoiceCount, voice_sources);
 
     alcMakeContextCurrent(nullptr);
     alcDestroyContext(audio_context);
@@ -256,12 +789,82 @@ void cleanup () {
 
 }
 
+// for checking what the state cache saves: call from the browser console as Module._log_gl_call_counts()
+extern "C" EMSCRIPTEN_KEEPALIVE void log_gl_call_counts () {
+  auto& counts = gl_cache.get_counts();
+  auto frames = std::max(frames_since_gl_counts_reset, 1L);
+  std::cout << "GL state calls per frame over the last " << frames << " frames: " <<
+    (double)counts.issued / frames << " issued, " << (double)counts.skipped / frames << " skipped" << std::endl;
+  gl_cache.reset_counts();
+  frames_since_gl_counts_reset = 0;
+}
+
+#ifdef PROFILER_ENABLED
+
+// saves everything in the profiler's buffers as a Chrome trace (for chrome://tracing or Perfetto):
+// Module._download_trace(), or press T
+extern "C" EMSCRIPTEN_KEEPALIVE void download_trace () {
+  save_trace();
+}
+
+#endif
+
+// saves the session since the page loaded as a replay, for tools/replay to check and benchmark:
+// Module._save_replay()
+extern "C" EMSCRIPTEN_KEEPALIVE void save_replay () {
+#ifdef SIM_THREAD
+  worker->request_replay();
+  replay_pending = true;
+#else
+  auto data = recorder.finish(get_game_state_hash());
+  download_file("breakthrough.replay", "application/octet-stream", data.data(), data.size());
+#endif
+}
+
+// sets how many times a second the backdrop animation advances (zero to freeze it): Module._set_backdrop_rate(30)
+extern "C" EMSCRIPTEN_KEEPALIVE void set_backdrop_rate (float rate) {
+  backdrop_rate = std::max(rate, 0.0f);
+  next_backdrop_time = 0.0;
+}
+
+// adjusts the dynamic resolution: Module._set_resolution_scaling(0.5, 1, 60); equal bounds fix the scale
+extern "C" EMSCRIPTEN_KEEPALIVE void set_resolution_scaling (float min_scale, float max_scale, float target_rate) {
+  resolution.set_bounds(min_scale, max_scale);
+  resolution.set_target_rate(target_rate);
+}
+
+// compares the cost of submitting draws one by one with batching them, on whichever WebGL the page got (load it with
+// ?webgl=1 to compare): Module._run_draw_benchmark(5000, 60)
+extern "C" EMSCRIPTEN_KEEPALIVE void run_draw_benchmark (int quads, int frames) {
+  benchmark_draw_submission(quads, frames);
+}
+
 int main () {
+  auto seed = (unsigned)std::chrono::system_clock::now().time_since_epoch().count();
+#ifdef SIM_THREAD
+  worker.reset(new sim_worker(seed, sim_clock.get_step_rate(), get_field_rows(), get_field_cols()));
+  worker->start();
+#else
+  set_game_listener(&frontend);
+  seed_game(seed);
+  reset_game();
+  recorder.begin(seed, sim_clock.get_step_rate(), get_field_rows(), get_field_cols(), kDefaultPredictionDepth);
+#endif
+
   EmscriptenWebGLContextAttributes attributes;
   emscripten_webgl_init_context_attributes(&attributes);
   attributes.alpha = false;
   attributes.depth = false;
+
+  // WebGL 2 where the browser has it (unless the page is loaded with ?webgl=1, for comparison), WebGL 1 otherwise
+  attributes.majorVersion = EM_ASM_INT({ return new URLSearchParams(location.search).get('webgl') == '1' ? 1 : 2; });
   webgl_context = emscripten_webgl_create_context("canvas", &attributes);
+  if (webgl_context <= 0 && attributes.majorVersion > 1) {
+    attributes.majorVersion = 1;
+    webgl_context = emscripten_webgl_create_context("canvas", &attributes);
+  }
+  webgl2 = (attributes.majorVersion == 2);
+  std::cout << "rendering with WebGL " << attributes.majorVersion << std::endl;
 
   init_context();
 
@@ -284,69 +887,146 @@ int main () {
   emscripten_set_touchstart_callback("canvas", nullptr, true, on_touch_start);
   emscripten_set_touchmove_callback("canvas", nullptr, true, on_touch_move);
 
+#ifdef PROFILER_ENABLED
+  emscripten_set_keydown_callback(EMSCRIPTEN_EVENT_TARGET_WINDOW, nullptr, false, on_key_down);
+#endif
+
   emscripten_set_webglcontextlost_callback("canvas", nullptr, false, on_webglcontext_lost);
   emscripten_set_webglcontextrestored_callback("canvas", nullptr, false, on_webglcontext_restored);
 }
 
 void reset_blocks () {
-  unsigned char texture_data[kFieldRows * kFieldCols * 4];
-  unsigned char* it = texture_data;
-  auto write_rgb = [&](float r, float g, float b) {
-    *it++ = (unsigned char)(255.0f * r);
-    *it++ = (unsigned char)(255.0f * g);
-    *it++ = (unsigned char)(255.0f * b);
-  };
-  for (auto row = 0; row < kFieldRows; ++row) {
-    for (auto col = 0; col < kFieldCols; ++col) {
-      auto hue = 5.0f * (row + col + 1.0f) / (kFieldCols + kFieldRows);
-      auto range = (int)hue;
-      auto level = hue - range;
-      switch (range) {
-        case 0: write_rgb(1.0f, level, 0.0f); break;
-        case 1: write_rgb(1.0f - level, 1.0f, 0.0f); break;
-        case 2: write_rgb(0.0f, 1.0f, level); break;
-        case 3: write_rgb(0.0f, 1.0f - level, 1.0f); break;
-        case 4: write_rgb(level, 0.0f, 1.0f); break;
+  auto rows = get_field_rows(), cols = get_field_cols();
+  if (block_colors.size() != (size_t)(rows * cols * 3)) init_block_colors(rows, cols);
+
+  // the copy is kept up to date by clear_block, so it only needs building from the game when the field is new; a
+  // restored context just uploads it again (with the simulation on a worker, the shared game isn't the one in play)
+  if (block_texture_data.size() != (size_t)(rows * cols * 4)) {
+    block_texture_data.resize(rows * cols * 4);
+    auto it = block_texture_data.begin();
+    for (auto row = 0; row < rows; ++row) {
+      for (auto col = 0; col < cols; ++col) {
+        auto color = block_colors.begin() + (row * cols + col) * 3;
+        it = std::copy(color, color + 3, it);
+        *it++ = get_block_state(row, col) ? 0x0 : 0xFF;
       }
-      *it++ = get_block_state(row, col) ? 0x0 : 0xFF;
     }
   }
-  glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, kFieldCols, kFieldRows, 0, GL_RGBA, GL_UNSIGNED_BYTE, texture_data);
+  changed_blocks.reset(rows, cols);
+  gl_cache.bind_texture(block_texture);
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, cols, rows, 0, GL_RGBA, GL_UNSIGNED_BYTE, block_texture_data.data());
+  PROFILE_COUNT("texture uploads", 1);
+  blocks_program->set_uniform("field_rows", (float)rows);
+  blocks_program->set_uniform("field_cols", (float)cols);
+  wall_dirty = true;
 }
 
-void clear_block (int row, int col) {
-  unsigned char texture_data[] {0, 0, 0, 0};
-  glTexSubImage2D(GL_TEXTURE_2D, 0, col, row, 1, 1, GL_RGBA, GL_UNSIGNED_BYTE, texture_data);
+void draw_frame (const sim_frame& frame, float alpha) {
+  PROFILE_ZONE("draw_frame");
+  auto time = last_time * kSecondsPerMillisecond;
+  if (webgl2) update_frame_uniforms(time);
+  auto scale = resolution.get_scale();
+  auto render_width = std::max((int)std::lround(canvas_width * scale), 1);
+  auto render_height = std::max((int)std::lround(canvas_height * scale), 1);
+  auto scaled = (render_width != canvas_width || render_height != canvas_height);
+  if (wall_layer->set_size(render_width, render_height)) wall_dirty = true;
+  if (scene_layer->set_size(render_width, render_height)) wall_dirty = true;
+  if (scaled) frame_layer->set_size(render_width, render_height);
+  glViewport(0, 0, render_width, render_height);
+
+  frame_options options;
+  options.alpha = alpha;
+  options.player_position = player_input;
+  options.wall_dirty = wall_dirty;
+  options.backdrop_due = (backdrop_rate > 0.0f && time >= next_backdrop_time);
+  options.particles_live = particles->is_live(time);
+  if (backdrop_rate > 0.0f && (wall_dirty || options.backdrop_due || !changed_blocks.is_empty())) {
+    next_backdrop_time = time + 1.0 / backdrop_rate;
+  }
+  wall_dirty = false;
+
+  frame_commands.clear();
+  queue_frame(frame, options, changed_blocks, frame_commands);
+  gl_backend.set_frame_layer(scaled ? frame_layer.get() : nullptr);
+  frame_commands.submit(gl_backend);
+
+  if (scaled) {
+    frame_layer->end();
+    glViewport(0, 0, canvas_width, canvas_height);
+    glDisable(GL_BLEND);
+    gl_cache.bind_texture(frame_layer->get_texture());
+    blit_program->draw_quad(0.0f, 0.0f, 1.0f, 1.0f / kAspect);
+    glEnable(GL_BLEND);
+  }
 }
 
-void play_launch (int ball) {
-  play_audio_buffer(ball, launch_buffer);
+void clear_block (int row, int col) {
+  auto texel = block_texture_data.begin() + (row * get_field_cols() + col) * 4;
+  std::fill(texel, texel + 4, 0);
+  changed_blocks.clear_block(row, col);
+
+  if (!particles) return;
+  auto rows = get_field_rows(), cols = get_field_cols();
+  particles->spawn((col + 0.5f) / cols - 0.5f, ((row + 0.5f) / rows - 0.5f) * kFieldHeight,
+    &block_colors[(row * cols + col) * 3], last_time * kSecondsPerMillisecond);
 }
 
-void play_bounce (int ball) {
-  static double last_bounce_times[sizeof(ball_sources) / sizeof(ball_sources[0])] {};
-  auto& last_bounce_time = last_bounce_times[ball];
-  constexpr double kMinElapsed = 0.05;
-  if ((last_time - last_bounce_time) * kSecondsPerMillisecond >= kMinElapsed) {
-    play_audio_buffer(ball, bounce_buffer);
-    last_bounce_time = last_time;
-  }
-}
+shader_program::shader_program (const char* fragment_name) : shader_program(quad_shader, fragment_name) {}
 
-void play_loss (int ball) {
-  play_audio_buffer(ball, loss_buffer);
+shader_program::shader_program (GLuint vertex_shader, const char* fragment_name) : name_(fragment_name) {
+  program_ = glCreateProgram();
+  fragment_shader_ = compile_shader(GL_FRAGMENT_SHADER, fragment_name);
+  if (vertex_shader) glAttachShader(program_, vertex_shader);
+  if (fragment_shader_) glAttachShader(program_, fragment_shader_);
+  glLinkProgram(program_);
 }
 
-shader_program::shader_program (const char* fragment_filename) {
-    program_ = glCreateProgram();
-    glAttachShader(program_, quad_shader);
-    glAttachShader(program_, fragment_shader_ = load_shader(GL_FRAGMENT_SHADER, fragment_filename));
-    glLinkProgram(program_);
-    vertex_location_ = glGetAttribLocation(program_, "vertex");
-    matrix_location_ = glGetUniformLocation(program_, "matrix");
-    aspect_location_ = glGetUniformLocation(program_, "aspect");
-    time_location_ = glGetUniformLocation(program_, "time");
+bool shader_program::poll_link () {
+  if (linked_) return true;
+  if (parallel_shader_compile) {
+    GLint complete;
+    glGetProgramiv(program_, GL_COMPLETION_STATUS_KHR, &complete);
+    if (!complete) return false;
+  }
+  linked_ = true;
+
+  GLint status;
+  glGetProgramiv(program_, GL_LINK_STATUS, &status);
+  if (!status) {
+    GLint length;
+    glGetProgramiv(program_, GL_INFO_LOG_LENGTH, &length);
+    std::vector<GLchar> log(length + 1);
+    glGetProgramInfoLog(program_, log.size(), nullptr, log.data());
+    std::cerr << "failed to link program: " << log.data() << std::endl;
+  }
+  vertex_location_ = glGetAttribLocation(program_, "vertex");
+
+  GLint uniform_count, max_length;
+  glGetProgramiv(program_, GL_ACTIVE_UNIFORMS, &uniform_count);
+  glGetProgramiv(program_, GL_ACTIVE_UNIFORM_MAX_LENGTH, &max_length);
+  std::vector<GLchar> name(max_length + 1);
+  for (auto index = 0; index < uniform_count; ++index) {
+    GLint size;
+    GLenum type;
+    glGetActiveUniform(program_, index, name.size(), nullptr, &size, &type, name.data());
+    // members of the frame's uniform block are set through its buffer, and have no location
+    auto location = glGetUniformLocation(program_, name.data());
+    if (location >= 0) uniforms_[name.data()].location = location;
+  }
+  matrix_uniform_ = find_uniform("matrix");
+  aspect_uniform_ = find_uniform("aspect");
+  time_uniform_ = find_uniform("time");
+
+  if (webgl2) {
+    auto block = glGetUniformBlockIndex(program_, "frame_uniforms");
+    if (block != GL_INVALID_INDEX) glUniformBlockBinding(program_, block, kFrameUniformBinding);
+    vertex_array_ = create_vertex_array();
+    gl_cache.bind_buffer(GL_ARRAY_BUFFER, buffer);
+    gl_cache.set_vertex_attrib_array_enabled(vertex_location_, true);
+    gl_cache.vertex_attrib_pointer(vertex_location_, 2, 0, 0);
   }
+  return true;
+}
 
 shader_program::~shader_program () {
   if (webgl_context_lost) return;
@@ -354,34 +1034,396 @@ shader_program::~shader_program () {
   emscripten_webgl_make_context_current(webgl_context);
   glDeleteProgram(program_);
   glDeleteShader(fragment_shader_);
+  if (vertex_array_) gl_cache.delete_vertex_array(vertex_array_);
+}
+
+void shader_program::use () const {
+  gl_cache.use_program(program_);
+}
+
+GLint shader_program::get_attrib_location (const char* name) const {
+  return glGetAttribLocation(program_, name);
 }
 
 void shader_program::set_uniform (const char* name, int value) const {
-  auto location = glGetUniformLocation(program_, name);
-  glUseProgram(program_);
-  glUniform1i(location, value);
+  auto uniform = find_uniform(name);
+  if (update_uniform(uniform, &value, sizeof(value))) glUniform1i(uniform->location, value);
 }
 
 void shader_program::set_uniform (const char* name, float value) const {
-  auto location = glGetUniformLocation(program_, name);
-  glUseProgram(program_);
-  glUniform1f(location, value);
+  auto uniform = find_uniform(name);
+  if (update_uniform(uniform, &value, sizeof(value))) glUniform1f(uniform->location, value);
+}
+
+void shader_program::set_uniform (const char* name, float x, float y) const {
+  auto uniform = find_uniform(name);
+  const GLfloat value[] {x, y};
+  if (update_uniform(uniform, value, sizeof(value))) glUniform2f(uniform->location, x, y);
 }
 
 void shader_program::draw_quad (GLfloat x, GLfloat y, GLfloat w, GLfloat h) const {
-  glUseProgram(program_);
+  PROFILE_ZONE(name_);
+  gl_cache.use_program(program_);
   constexpr GLfloat kXScale = 2.0f;
   constexpr GLfloat kYScale = kAspect * 2.0f;
   GLfloat matrix[] = {w * kXScale, 0.0f, 0.0f, 0.0f, h * kYScale, 0.0f, x * kXScale, y * kYScale, 1.0f};
-  glUniformMatrix3fv(matrix_location_, 1, false, matrix);
-  glUniform1f(aspect_location_, w / h);
-  if (time_location_ != -1) glUniform1f(time_location_, last_time * kSecondsPerMillisecond);
-  glEnableVertexAttribArray(vertex_location_);
-  glVertexAttribPointer(vertex_location_, 2, GL_FLOAT, false, 0, nullptr);
+  if (update_uniform(matrix_uniform_, matrix, sizeof(matrix))) {
+    glUniformMatrix3fv(matrix_uniform_->location, 1, false, matrix);
+  }
+  GLfloat aspect = w / h;
+  if (update_uniform(aspect_uniform_, &aspect, sizeof(aspect))) glUniform1f(aspect_uniform_->location, aspect);
+  GLfloat time = last_time * kSecondsPerMillisecond;
+  if (update_uniform(time_uniform_, &time, sizeof(time))) glUniform1f(time_uniform_->location, time);
+  if (vertex_array_) {
+    gl_cache.bind_vertex_array(vertex_array_);
+  } else {
+    gl_cache.bind_buffer(GL_ARRAY_BUFFER, buffer);
+    gl_cache.set_vertex_attrib_array_enabled(vertex_location_, true);
+    gl_cache.vertex_attrib_pointer(vertex_location_, 2, 0, 0);
+  }
   glDrawArrays(GL_TRIANGLE_FAN, 0, 4);
+  PROFILE_COUNT("draw calls", 1);
+}
+
+shader_program::uniform* shader_program::find_uniform (const char* name) const {
+  auto it = uniforms_.find(name);
+  return (it == uniforms_.end()) ? nullptr : &it->second;
+}
+
+bool shader_program::update_uniform (uniform* uniform, const void* value, std::size_t size) const {
+  // uniforms the program doesn't use don't exist as far as GL is concerned
+  if (!uniform) return false;
+  if (uniform->uploaded && std::memcmp(uniform->value, value, size) == 0) {
+    gl_cache.count_skipped();
+    return false;
+  }
+  std::memcpy(uniform->value, value, size);
+  uniform->uploaded = true;
+  gl_cache.count_issued();
+  gl_cache.use_program(program_);
+  return true;
+}
+
+sprite_batch::sprite_batch (const shader_program& program, bool instanced) :
+    program_(program),
+    instanced_(instanced),
+    vertex_location_(program.get_attrib_location("vertex")),
+    sprite_location_(program.get_attrib_location("sprite")) {
+  glGenBuffers(1, &buffer_);
+
+  // the layout never changes, so on WebGL 2 it's set up once
+  if (webgl2) {
+    vertex_array_ = create_vertex_array();
+    set_up_attributes();
+  }
+}
+
+sprite_batch::~sprite_batch () {
+  if (webgl_context_lost) return;
+
+  emscripten_webgl_make_context_current(webgl_context);
+  glDeleteBuffers(1, &buffer_);
+  if (vertex_array_) gl_cache.delete_vertex_array(vertex_array_);
+}
+
+void sprite_batch::add (GLfloat x, GLfloat y, GLfloat w, GLfloat h) {
+  ++count_;
+  if (instanced_) {
+    data_.insert(data_.end(), {x, y, w, h});
+    return;
+  }
+  // two triangles, each vertex carrying its unit quad corner along with the sprite
+  const GLfloat kCorners[] {-0.5f, -0.5f, 0.5f, -0.5f, 0.5f, 0.5f, -0.5f, -0.5f, 0.5f, 0.5f, -0.5f, 0.5f};
+  for (auto corner = std::begin(kCorners); corner != std::end(kCorners); corner += 2) {
+    data_.insert(data_.end(), {corner[0], corner[1], x, y, w, h});
+  }
+}
+
+void sprite_batch::flush () {
+  if (count_ == 0) return;
+  PROFILE_ZONE("sprite_batch::flush");
+
+  program_.use();
+  gl_cache.bind_buffer(GL_ARRAY_BUFFER, buffer_);
+  GLsizeiptr size = data_.size() * sizeof(GLfloat);
+  if (size > buffer_capacity_) {
+    glBufferData(GL_ARRAY_BUFFER, size, data_.data(), GL_STREAM_DRAW);
+    buffer_capacity_ = size;
+  } else {
+    glBufferSubData(GL_ARRAY_BUFFER, 0, size, data_.data());
+  }
+  if (vertex_array_) gl_cache.bind_vertex_array(vertex_array_);
+  else set_up_attributes();
+
+  if (instanced_) glDrawArraysInstanced(GL_TRIANGLE_FAN, 0, 4, count_);
+  else glDrawArrays(GL_TRIANGLES, 0, count_ * 6);
+  PROFILE_COUNT("draw calls", 1);
+
+  // the quad programs don't read the sprite attribute, so leave it disabled (and undivided) for them
+  if (!vertex_array_) {
+    if (instanced_) gl_cache.vertex_attrib_divisor(sprite_location_, 0);
+    gl_cache.set_vertex_attrib_array_enabled(sprite_location_, false);
+  }
+
+  data_.clear();
+  count_ = 0;
+}
+
+void sprite_batch::set_up_attributes () {
+  gl_cache.set_vertex_attrib_array_enabled(sprite_location_, true);
+  gl_cache.set_vertex_attrib_array_enabled(vertex_location_, true);
+  gl_cache.bind_buffer(GL_ARRAY_BUFFER, buffer_);
+
+  if (instanced_) {
+    gl_cache.vertex_attrib_pointer(sprite_location_, 4, 0, 0);
+    gl_cache.vertex_attrib_divisor(sprite_location_, 1);
+    gl_cache.bind_buffer(GL_ARRAY_BUFFER, buffer);
+    gl_cache.vertex_attrib_pointer(vertex_location_, 2, 0, 0);
+
+  } else {
+    constexpr GLsizei kStride = 6 * sizeof(GLfloat);
+    gl_cache.vertex_attrib_pointer(vertex_location_, 2, kStride, 0);
+    gl_cache.vertex_attrib_pointer(sprite_location_, 4, kStride, 2 * sizeof(GLfloat));
+  }
+}
+
+particle_system::particle_system (const shader_program& program, bool instanced) :
+    program_(program),
+    instanced_(instanced),
+    vertex_location_(program.get_attrib_location("vertex")),
+    burst_location_(program.get_attrib_location("burst")),
+    color_location_(program.get_attrib_location("color")),
+    dirty_min_slot_(kMaxBursts),
+    last_spawn_time_(-kParticleLifetime) {
+  const GLfloat kCorners[] {-0.5f, -0.5f, 0.5f, -0.5f, 0.5f, 0.5f, -0.5f, -0.5f, 0.5f, 0.5f, -0.5f, 0.5f};
+  for (auto particle = 0; particle < kParticlesPerBurst; ++particle) {
+    for (auto corner = std::begin(kCorners); corner != std::end(kCorners); corner += 2) {
+      corners_.insert(corners_.end(), {corner[0], corner[1], (GLfloat)particle / kParticlesPerBurst});
+    }
+  }
+  if (instanced_) {
+    glGenBuffers(1, &corner_buffer_);
+    gl_cache.bind_buffer(GL_ARRAY_BUFFER, corner_buffer_);
+    glBufferData(GL_ARRAY_BUFFER, corners_.size() * sizeof(GLfloat), corners_.data(), GL_STATIC_DRAW);
+  }
+
+  // every burst starts out long over
+  const GLfloat kFinished[kRecordSize] {0.0f, 0.0f, -1000.0f, 0.0f, 0.0f, 0.0f};
+  records_.resize(kMaxBursts * get_slot_size());
+  for (auto slot = 0; slot < kMaxBursts; ++slot) write_record(slot, kFinished);
+  glGenBuffers(1, &record_buffer_);
+  gl_cache.bind_buffer(GL_ARRAY_BUFFER, record_buffer_);
+  glBufferData(GL_ARRAY_BUFFER, records_.size() * sizeof(GLfloat), records_.data(), GL_DYNAMIC_DRAW);
+
+  if (webgl2) {
+    vertex_array_ = create_vertex_array();
+    set_up_attributes();
+  }
+}
+
+particle_system::~particle_system () {
+  if (webgl_context_lost) return;
+
+  emscripten_webgl_make_context_current(webgl_context);
+  glDeleteBuffers(1, &record_buffer_);
+  if (corner_buffer_) glDeleteBuffers(1, &corner_buffer_);
+  if (vertex_array_) gl_cache.delete_vertex_array(vertex_array_);
+}
+
+void particle_system::spawn (GLfloat x, GLfloat y, const unsigned char* rgb, GLfloat time) {
+  const GLfloat record[kRecordSize] {x, y, time, rgb[0] / 255.0f, rgb[1] / 255.0f, rgb[2] / 255.0f};
+  write_record(next_slot_, record);
+  dirty_min_slot_ = std::min(dirty_min_slot_, next_slot_);
+  dirty_max_slot_ = std::max(dirty_max_slot_, next_slot_);
+  next_slot_ = (next_slot_ + 1) % kMaxBursts;
+  last_spawn_time_ = time;
+}
+
+bool particle_system::is_live (GLfloat time) const {
+  return time - last_spawn_time_ <= kParticleLifetime;
+}
+
+void particle_system::draw (GLfloat time) {
+  PROFILE_ZONE("particle_system::draw");
+  program_.use();
+  program_.set_uniform("time", time);
+  gl_cache.bind_buffer(GL_ARRAY_BUFFER, record_buffer_);
+
+  // the slots written since the last draw are uploaded as one span (the whole ring, if they've wrapped around)
+  if (dirty_min_slot_ <= dirty_max_slot_) {
+    auto slot_size = get_slot_size();
+    glBufferSubData(GL_ARRAY_BUFFER, dirty_min_slot_ * slot_size * sizeof(GLfloat),
+      (dirty_max_slot_ - dirty_min_slot_ + 1) * slot_size * sizeof(GLfloat), &records_[dirty_min_slot_ * slot_size]);
+    PROFILE_COUNT("buffer uploads", 1);
+    dirty_min_slot_ = kMaxBursts;
+    dirty_max_slot_ = -1;
+  }
+  if (vertex_array_) gl_cache.bind_vertex_array(vertex_array_);
+  else set_up_attributes();
+
+  if (instanced_) glDrawArraysInstanced(GL_TRIANGLES, 0, kParticleVertices, kMaxBursts);
+  else glDrawArrays(GL_TRIANGLES, 0, kParticleVertices * kMaxBursts);
+  PROFILE_COUNT("draw calls", 1);
+
+  // as with the sprites, leave the extra attributes disabled (and undivided) for the quad programs
+  if (!vertex_array_) {
+    if (instanced_) {
+      gl_cache.vertex_attrib_divisor(burst_location_, 0);
+      gl_cache.vertex_attrib_divisor(color_location_, 0);
+    }
+    gl_cache.set_vertex_attrib_array_enabled(burst_location_, false);
+    gl_cache.set_vertex_attrib_array_enabled(color_location_, false);
+  }
+}
+
+void particle_system::set_up_attributes () {
+  gl_cache.set_vertex_attrib_array_enabled(vertex_location_, true);
+  gl_cache.set_vertex_attrib_array_enabled(burst_location_, true);
+  gl_cache.set_vertex_attrib_array_enabled(color_location_, true);
+  gl_cache.bind_buffer(GL_ARRAY_BUFFER, record_buffer_);
+
+  if (instanced_) {
+    constexpr GLsizei kStride = kRecordSize * sizeof(GLfloat);
+    gl_cache.vertex_attrib_pointer(burst_location_, 3, kStride, 0);
+    gl_cache.vertex_attrib_pointer(color_location_, 3, kStride, 3 * sizeof(GLfloat));
+    gl_cache.vertex_attrib_divisor(burst_location_, 1);
+    gl_cache.vertex_attrib_divisor(color_location_, 1);
+    gl_cache.bind_buffer(GL_ARRAY_BUFFER, corner_buffer_);
+    gl_cache.vertex_attrib_pointer(vertex_location_, kCornerSize, 0, 0);
+
+  } else {
+    constexpr GLsizei kStride = (kCornerSize + kRecordSize) * sizeof(GLfloat);
+    gl_cache.vertex_attrib_pointer(vertex_location_, kCornerSize, kStride, 0);
+    gl_cache.vertex_attrib_pointer(burst_location_, 3, kStride, kCornerSize * sizeof(GLfloat));
+    gl_cache.vertex_attrib_pointer(color_location_, 3, kStride, (kCornerSize + 3) * sizeof(GLfloat));
+  }
+}
+
+int particle_system::get_slot_size () const {
+  return instanced_ ? kRecordSize : kParticleVertices * (kCornerSize + kRecordSize);
+}
+
+void particle_system::write_record (int slot, const GLfloat* record) {
+  auto out = records_.begin() + slot * get_slot_size();
+  if (instanced_) {
+    std::copy(record, record + kRecordSize, out);
+    return;
+  }
+  for (auto corner = corners_.begin(); corner != corners_.end(); corner += kCornerSize) {
+    out = std::copy(corner, corner + kCornerSize, out);
+    out = std::copy(record, record + kRecordSize, out);
+  }
+}
+
+void gl_render_backend::submit (const render_command* commands, std::size_t count) {
+  const shader_program* programs[] {backdrop_program.get(), paddle_program.get(), ball_program.get(),
+    blocks_program.get(), blit_program.get(), particle_program.get()};
+  sprite_batch* batches[] {nullptr, paddle_batch.get(), ball_batch.get(), nullptr, nullptr, nullptr};
+  const GLuint textures[] {0, scene_layer->get_texture(), block_texture, wall_layer->get_texture()};
+
+  sprite_batch* batch = nullptr;
+  auto pass = -1;
+  for (auto command = commands; command != commands + count; ++command) {
+    if (command->pass != pass) {
+      if (batch) batch->flush();
+      batch = nullptr;
+      pass = command->pass;
+      begin_pass(command->pass);
+    }
+    if (command->pass == render_command::kBlockUploads) {
+      gl_cache.bind_texture(block_texture);
+      upload_blocks((int)command->x, (int)command->y, (int)command->w, (int)command->h);
+      continue;
+    }
+    auto command_batch = batches[command->program];
+    if (batch && batch != command_batch) batch->flush();
+    batch = command_batch;
+    if (batch) {
+      batch->add(command->x, command->y, command->w, command->h);
+      continue;
+    }
+    if (command->program == render_command::kParticles) {
+      particles->draw(last_time * kSecondsPerMillisecond);
+      continue;
+    }
+
+    // the wall and the background replace whatever was there, alpha and all
+    auto opaque = (command->pass == render_command::kWall || command->pass == render_command::kBackground);
+    if (opaque) glDisable(GL_BLEND);
+    if (command->texture != render_command::kNoTexture) gl_cache.bind_texture(textures[command->texture]);
+    programs[command->program]->draw_quad(command->x, command->y, command->w, command->h);
+    if (opaque) glEnable(GL_BLEND);
+  }
+  if (batch) batch->flush();
+}
+
+void gl_render_backend::begin_pass (render_command::pass_type pass) {
+  switch (pass) {
+    case render_command::kBlockUploads:
+      break;
+
+    case render_command::kWall:
+      wall_layer->begin();
+      glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+      glClear(GL_COLOR_BUFFER_BIT);
+      break;
+
+    case render_command::kScene:
+      scene_layer->begin();
+      break;
+
+    case render_command::kBackground:
+      if (frame_layer_) frame_layer_->begin();
+      else gl_cache.bind_framebuffer(0);
+      break;
+
+    case render_command::kSprites:
+      break;
+  }
 }
 
 std::unique_ptr<shader_program> backdrop_program;
 std::unique_ptr<shader_program> paddle_program;
 std::unique_ptr<shader_program> ball_program;
-std::unique_ptr<shader_program> blocks_program;
\ No newline at end of file
+std::unique_ptr<shader_program> blocks_program;
+std::unique_ptr<shader_program> blit_program;
+std::unique_ptr<shader_program> particle_program;
+
+render_layer::render_layer (GLint filter) {
+  glGenFramebuffers(1, &framebuffer_);
+  glGenTextures(1, &texture_);
+  gl_cache.bind_texture(texture_);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, filter);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, filter);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+}
+
+render_layer::~render_layer () {
+  if (webgl_context_lost) return;
+
+  emscripten_webgl_make_context_current(webgl_context);
+  glDeleteFramebuffers(1, &framebuffer_);
+  glDeleteTextures(1, &texture_);
+}
+
+bool render_layer::set_size (int width, int height) {
+  if (width == width_ && height == height_) return false;
+  width_ = width;
+  height_ = height;
+  gl_cache.bind_texture(texture_);
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+  gl_cache.bind_framebuffer(framebuffer_);
+  glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture_, 0);
+  gl_cache.bind_framebuffer(0);
+  return true;
+}
+
+void render_layer::begin () const {
+  // the layers all match the render resolution, so the viewport stays as it is
+  gl_cache.bind_framebuffer(framebuffer_);
+}
+
+void render_layer::end () const {
+  gl_cache.bind_framebuffer(0);
+}
\ No newline at end of file
@@ -0,0 +1,101 @@
+#include <algorithm>
+#include <cmath>
+
+#include "ball_grid.hpp"
+
+ball_grid::ball_grid (float cell_size, float half_width, float half_height) :
+    half_width_(half_width),
+    half_height_(half_height),
+    inverse_cell_size_(1.0f / cell_size),
+    cols_(std::max((int)std::ceil(half_width * 2.0f / cell_size), 1)),
+    rows_(std::max((int)std::ceil(half_height * 2.0f / cell_size), 1)) {}
+
+void ball_grid::build (const ball_pool& balls) {
+  auto count = balls.size();
+  auto bucketed = 0;
+  for (auto ball = 0; ball < count; ++ball) {
+    if (!(balls.flags[ball] & kBallAttached)) ++bucketed;
+  }
+  cells_.resize(bucketed);
+  indices_.resize(bucketed);
+  x_.resize(bucketed);
+  y_.resize(bucketed);
+  auto place = [&](int slot, int ball, int cell) {
+    cells_[slot] = cell;
+    indices_[slot] = ball;
+    x_[slot] = balls.x[ball];
+    y_[slot] = balls.y[ball];
+  };
+
+  // a few balls are simply listed, with no need for their cells
+  unsorted_ = (bucketed <= kMaxUnsorted);
+  if (unsorted_) {
+    for (auto ball = 0, slot = 0; ball < count; ++ball) {
+      if (!(balls.flags[ball] & kBallAttached)) place(slot++, ball, 0);
+    }
+    return;
+  }
+
+  ball_cells_.resize(count);
+  for (auto ball = 0; ball < count; ++ball) {
+    ball_cells_[ball] = (balls.flags[ball] & kBallAttached) ? -1 : get_cell(balls.x[ball], balls.y[ball]);
+  }
+
+  // count the balls in each cell (one along, so that the prefix sum leaves each cell's start in its own entry)...
+  auto cell_count = cols_ * rows_;
+  cell_starts_.assign(cell_count + 1, 0);
+  for (auto ball = 0; ball < count; ++ball) {
+    if (ball_cells_[ball] >= 0) ++cell_starts_[ball_cells_[ball] + 1];
+  }
+  for (auto cell = 0; cell < cell_count; ++cell) cell_starts_[cell + 1] += cell_starts_[cell];
+
+  // ...then scatter them in index order, so that each cell lists its balls in ascending order
+  cursors_.assign(cell_starts_.begin(), cell_starts_.end() - 1);
+  for (auto ball = 0; ball < count; ++ball) {
+    auto cell = ball_cells_[ball];
+    if (cell >= 0) place(cursors_[cell]++, ball, cell);
+  }
+}
+
+long ball_grid::find_pairs (float distance, std::vector<ball_pair>& pairs) const {
+  pairs.clear();
+  auto distance_squared = distance * distance;
+  long tested = 0;
+  auto test_span = [&](int slot, int first, int last) {
+    auto x = x_[slot], y = y_[slot];
+    tested += last - first;
+    for (auto other = first; other < last; ++other) {
+      auto dx = x_[other] - x, dy = y_[other] - y;
+      if (dx * dx + dy * dy >= distance_squared) continue;
+      auto a = indices_[slot], b = indices_[other];
+      pairs.push_back((a < b) ? ball_pair {a, b} : ball_pair {b, a});
+    }
+  };
+
+  auto count = (int)indices_.size();
+  if (unsorted_) {
+    for (auto slot = 0; slot < count; ++slot) test_span(slot, slot + 1, count);
+    return tested;
+  }
+
+  // each ball is tested against those after it in its cell and in the neighbouring cells that follow (right, then
+  // the three in the next row), so that every pair comes up once; the cells in each of those runs are adjacent in the
+  // arrays.  going by ball rather than by cell, the empty cells cost nothing
+  for (auto slot = 0; slot < count; ++slot) {
+    auto cell = cells_[slot];
+    auto row = cell / cols_, col = cell % cols_;
+    auto has_left = (col > 0), has_right = (col + 1 < cols_);
+    test_span(slot, slot + 1, cell_starts_[cell + 1 + has_right]);
+    if (row + 1 < rows_) {
+      auto below = cell + cols_;
+      test_span(slot, cell_starts_[below - has_left], cell_starts_[below + 1 + has_right]);
+    }
+  }
+  return tested;
+}
+
+int ball_grid::get_cell (float x, float y) const {
+  auto col = std::min(std::max((int)std::floor((x + half_width_) * inverse_cell_size_), 0), cols_ - 1);
+  auto row = std::min(std::max((int)std::floor((y + half_height_) * inverse_cell_size_), 0), rows_ - 1);
+  return row * cols_ + col;
+}
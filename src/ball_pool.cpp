@@ -0,0 +1,93 @@
+#include "ball_pool.hpp"
+#include "simd.hpp"
+#include "vec_math.hpp"
+
+namespace {
+
+int pad (int size) {
+  return (size + simd::kWidth - 1) / simd::kWidth * simd::kWidth;
+}
+
+}
+
+void ball_pool::reserve (int capacity) {
+  capacity = pad(capacity);
+  for (auto array : {&x, &y, &previous_x, &previous_y, &vx, &vy}) array->reserve(capacity);
+  flags.reserve(capacity);
+  predicted_x.reserve(capacity);
+  prediction_stamps.reserve(capacity);
+}
+
+int ball_pool::add (float x, float y, float vx, float vy, std::uint32_t flags) {
+  auto index = size_++;
+  resize(pad(size_));
+  this->x[index] = previous_x[index] = x;
+  this->y[index] = previous_y[index] = y;
+  this->vx[index] = vx;
+  this->vy[index] = vy;
+  this->flags[index] = flags;
+  prediction_stamps[index] = 0;
+  return index;
+}
+
+void ball_pool::remove (int index) {
+  auto last = --size_;
+  for (auto array : {&x, &y, &previous_x, &previous_y, &vx, &vy}) (*array)[index] = (*array)[last];
+  flags[index] = flags[last];
+  predicted_x[index] = predicted_x[last];
+  prediction_stamps[index] = prediction_stamps[last];
+  resize(pad(size_));
+}
+
+void ball_pool::clear () {
+  size_ = 0;
+  resize(0);
+}
+
+void ball_pool::resize (int padded_size) {
+  // padding lanes hold attached, motionless balls so that they never turn into candidates or wander off
+  for (auto array : {&x, &y, &previous_x, &previous_y, &vx, &vy}) array->resize(padded_size, 0.0f);
+  flags.resize(padded_size, kBallAttached);
+  for (auto index = size_; index < padded_size; ++index) flags[index] = kBallAttached;
+  predicted_x.resize(padded_size, 0.0f);
+  prediction_stamps.resize(padded_size, 0);
+}
+
+void ball_pool::integrate (float dt, float radius, const ball_bounds& bounds, std::vector<ball_candidate>& candidates) {
+  using namespace simd;
+  candidates.clear();
+  auto dt4 = splat(dt);
+  auto max_x = splat(bounds.max_x - radius);
+  auto max_y = splat(bounds.max_y - radius);
+  auto min_block_y = splat(bounds.min_block_y - radius);
+  auto max_block_y = splat(bounds.max_block_y + radius);
+  auto padded_size = pad(size_);
+  for (auto base = 0; base < padded_size; base += kWidth) {
+    auto p0 = vec2x4::load(&x[base], &y[base]);
+    p0.store(&previous_x[base], &previous_y[base]);
+    auto p1 = p0 + vec2x4::load(&vx[base], &vy[base]) * dt4;
+    auto x0 = p0.x, y0 = p0.y, x1 = p1.x, y1 = p1.y;
+
+    // swept extents over the step
+    auto near_wall = max(abs(x0), abs(x1)) > max_x;
+    auto near_paddle = max(abs(y0), abs(y1)) > max_y;
+    auto near_blocks = (max(y0, y1) > min_block_y) & (min(y0, y1) < max_block_y);
+    auto attached = test_flags(&flags[base], kBallAttached);
+    auto hold = near_wall | near_paddle | near_blocks | attached;
+
+    store(&x[base], select(hold, x0, x1));
+    store(&y[base], select(hold, y0, y1));
+
+    auto wall_lanes = bits(near_wall), paddle_lanes = bits(near_paddle), block_lanes = bits(near_blocks);
+    for (auto lanes = bits(hold); lanes != 0; lanes &= lanes - 1) {
+      auto lane = __builtin_ctz(lanes);
+      auto index = base + lane;
+      if (index >= size_) continue;
+      std::uint32_t near = 0;
+      if (wall_lanes >> lane & 1) near |= kNearWall;
+      if (paddle_lanes >> lane & 1) near |= kNearPaddle;
+      if (block_lanes >> lane & 1) near |= kNearBlocks;
+      candidates.push_back({index, near});
+    }
+  }
+}
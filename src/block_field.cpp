@@ -0,0 +1,44 @@
+#include "block_field.hpp"
+
+void block_field::reset (int rows, int cols) {
+  rows_ = rows;
+  cols_ = cols;
+  words_per_row_ = (cols + kWordBits - 1) / kWordBits;
+  block_count_ = rows * cols;
+
+  words_.assign(rows * words_per_row_, ~0ull);
+  if (cols % kWordBits != 0) {
+    for (auto row = 0; row < rows; ++row) words_[(row + 1) * words_per_row_ - 1] = ~0ull >> (kWordBits - cols % kWordBits);
+  }
+  summaries_.assign(rows, word_range_mask(0, words_per_row_ - 1));
+
+  row_summaries_.assign((rows + kWordBits - 1) / kWordBits, ~0ull);
+  if (rows % kWordBits != 0) row_summaries_.back() = ~0ull >> (kWordBits - rows % kWordBits);
+}
+
+void block_field::clear (int row, int col) {
+  auto word_index = col / kWordBits;
+  auto& word = words_[row * words_per_row_ + word_index];
+  auto bit = 1ull << (col % kWordBits);
+  if (!(word & bit)) return;
+  word &= ~bit;
+  --block_count_;
+  if (word != 0) return;
+  auto& summary = summaries_[row];
+  summary &= ~(1ull << word_index);
+  if (summary == 0) row_summaries_[row / kWordBits] &= ~(1ull << (row % kWordBits));
+}
+
+int block_field::get_first_row () const {
+  for (auto index = 0; index < (int)row_summaries_.size(); ++index) {
+    if (row_summaries_[index] != 0) return index * kWordBits + __builtin_ctzll(row_summaries_[index]);
+  }
+  return rows_;
+}
+
+int block_field::get_last_row () const {
+  for (auto index = (int)row_summaries_.size() - 1; index >= 0; --index) {
+    if (row_summaries_[index] != 0) return index * kWordBits + kWordBits - 1 - __builtin_clzll(row_summaries_[index]);
+  }
+  return -1;
+}
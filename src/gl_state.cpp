@@ -0,0 +1,74 @@
+#include <GLES3/gl3.h>
+
+#include "gl_state.hpp"
+
+void gl_state::reset () {
+  program_ = array_buffer_ = texture_ = framebuffer_ = vertex_array_ = kUnknown;
+  forget_vertex_array_state();
+}
+
+void gl_state::forget_vertex_array_state () {
+  element_array_buffer_ = kUnknown;
+  for (auto index = 0; index < kMaxAttribs; ++index) {
+    attribs_enabled_[index] = -1;
+    attrib_pointers_[index] = {kUnknown, 0, 0, 0};
+    attrib_divisors_[index] = kUnknown;
+  }
+}
+
+void gl_state::use_program (GLuint program) {
+  if (update(program_, program)) glUseProgram(program);
+}
+
+void gl_state::bind_buffer (GLenum target, GLuint buffer) {
+  auto& cached = (target == GL_ELEMENT_ARRAY_BUFFER) ? element_array_buffer_ : array_buffer_;
+  if (update(cached, buffer)) glBindBuffer(target, buffer);
+}
+
+void gl_state::bind_texture (GLuint texture) {
+  if (update(texture_, texture)) glBindTexture(GL_TEXTURE_2D, texture);
+}
+
+void gl_state::bind_framebuffer (GLuint framebuffer) {
+  if (update(framebuffer_, framebuffer)) glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+}
+
+void gl_state::bind_vertex_array (GLuint vertex_array) {
+  if (!update(vertex_array_, vertex_array)) return;
+  glBindVertexArray(vertex_array);
+  forget_vertex_array_state();
+}
+
+void gl_state::delete_vertex_array (GLuint vertex_array) {
+  // deleting the bound array reverts to the default one, and the name may be handed out again
+  if (vertex_array_ == vertex_array) {
+    vertex_array_ = 0;
+    forget_vertex_array_state();
+  }
+  glDeleteVertexArrays(1, &vertex_array);
+}
+
+void gl_state::set_vertex_attrib_array_enabled (GLuint index, bool enabled) {
+  if (!update(attribs_enabled_[index], (int)enabled)) return;
+  if (enabled) glEnableVertexAttribArray(index);
+  else glDisableVertexAttribArray(index);
+}
+
+void gl_state::vertex_attrib_pointer (GLuint index, GLint size, GLsizei stride, GLintptr offset) {
+  // the pointer captures whichever buffer is bound at the time, so that's part of the state too
+  auto& cached = attrib_pointers_[index];
+  if (cached.buffer == array_buffer_ && cached.size == size && cached.stride == stride && cached.offset == offset) {
+    ++counts_.skipped;
+    return;
+  }
+  cached = {array_buffer_, size, stride, offset};
+  ++counts_.issued;
+  glVertexAttribPointer(index, size, GL_FLOAT, false, stride, (const void*)offset);
+}
+
+// on a WebGL 1 context, Emscripten routes the core instancing calls to ANGLE_instanced_arrays
+void gl_state::vertex_attrib_divisor (GLuint index, GLuint divisor) {
+  if (update(attrib_divisors_[index], divisor)) glVertexAttribDivisor(index, divisor);
+}
+
+gl_state gl_cache;
@@ -1,147 +1,399 @@
 #include <algorithm>
 #include <array>
-#include <bitset>
 #include <chrono>
 #include <cmath>
 #include <iostream>
+#include <limits>
 #include <random>
+#include <vector>
 
-#include "app.hpp"
+#include "ball_grid.hpp"
+#include "ball_pool.hpp"
+#include "block_field.hpp"
+#include "fnv_hash.hpp"
 #include "logic.hpp"
+#include "profiler.hpp"
+#include "vec_math.hpp"
 
 namespace {
 
-constexpr float kPaddleWidth = 0.2f;
-constexpr float kPaddleHeight = 0.05f;
-constexpr float kPaddleY = 0.5f / kAspect - kPaddleHeight * 0.5f;
-constexpr float kMaxPaddleX = 0.5f - kPaddleWidth * 0.5f;
-
-constexpr float kBallRadius = 0.025f;
-constexpr float kBallDiameter = kBallRadius * 2.0f;
 constexpr float kBallSpeed = 0.5f;
 
-constexpr float kFieldHeight = 1.0f;
-
-constexpr int kComputerBallIndex = 0;
-constexpr int kPlayerBallIndex = 1;
-
-float computer_position = 0.0f;
-float player_position = 0.0f;
-
-std::bitset<kFieldRows * kFieldCols> block_states;
-
-struct vec2 {
-  float x, y;
-
-  vec2 (float x = 0.0f, float y = 0.0f) : x(x), y(y) {}
-
-  vec2 operator+ (const vec2& o) const { return vec2(x + o.x, y + o.y); }
-  vec2 operator- (const vec2& o) const { return vec2(x - o.x, y - o.y); }
-  vec2 operator- () const { return vec2(-x, -y); }
-  vec2 operator* (float s) const { return vec2(x * s, y * s); }
-  vec2 operator/ (float s) const { return *this * (1.0f / s); }
-  
-  vec2& operator+= (const vec2& o) { x += o.x; y += o.y; return *this; }
-  vec2& operator-= (const vec2& o) { x -= o.x; y -= o.y; return *this; }
-  vec2& operator*= (float s) { x *= s; y *= s; return *this; }
-  vec2& operator/= (float s) { return *this *= (1.0f / s); }
-
-  float length_squared () const { return x * x + y * y; }
-  float length () const { return std::hypot(x, y); }
-  vec2 normalize () const { return *this / length(); }
-  vec2 ortho () const { return vec2(y, -x); }
-  float dot (const vec2& o) const { return x * o.x + y * o.y; }
-  vec2 reflect (const vec2& n) const { return n * dot(n) * 2.0f - *this; }
-};
+// a bounce never sends a ball off closer to horizontal than this, so that it can't shuttle between the side walls
+constexpr double kMinBounceAngle = kPi / 16;
+constexpr float kMinBounceCos = constexpr_cos(kMinBounceAngle);
+constexpr float kMinBounceSin = constexpr_sin(kMinBounceAngle);
 
 template<typename T>
 T clamp (T value, T min, T max) {
   return std::min(std::max(value, min), max);
 }
 
-class Ball {
-public:
-  Ball (bool player_owned) : player_owned_(player_owned) {}
+}
 
-  const vec2& get_position () const { return position_; }
-  const vec2& get_velocity () const { return velocity_; }
+// a scalar copy of one ball in the pool, for the narrow phase and anything else that handles balls one at a time
+class game::Ball {
+public:
+  Ball (game& context, int index) :
+    game_(context),
+    balls_(context.balls_),
+    index_(index),
+    player_owned_(balls_.flags[index] & kBallPlayerOwned),
+    position_(balls_.x[index], balls_.y[index]),
+    previous_position_(balls_.previous_x[index], balls_.previous_y[index]),
+    velocity_(balls_.vx[index], balls_.vy[index]),
+    attached_(balls_.flags[index] & kBallAttached) {}
+
+  // writes the ball back to the pool
+  void store () const {
+    balls_.x[index_] = position_.x;
+    balls_.y[index_] = position_.y;
+    balls_.previous_x[index_] = previous_position_.x;
+    balls_.previous_y[index_] = previous_position_.y;
+    balls_.vx[index_] = velocity_.x;
+    balls_.vy[index_] = velocity_.y;
+    balls_.flags[index_] = (attached_ ? kBallAttached : 0) | (player_owned_ ? kBallPlayerOwned : 0);
+    if (velocity_changed_) balls_.prediction_stamps[index_] = 0;
+  }
 
-  bool is_attached () const { return attached_; }
+  // spawned balls are removed rather than reattached when they leave the field
+  bool is_lost () const { return lost_; }
 
   void maybe_release () {
     if (!attached_) return;
     velocity_ = vec2(M_SQRT1_2, M_SQRT1_2) * kBallSpeed * (player_owned_ ? 1.0f : -1.0f);
+    velocity_changed_ = true;
     attached_ = false;
-    play_launch(player_owned_);
+    game_.listener_.play_launch(index_);
+  }
+
+  // follows the ball's path (without moving it) through up to depth wall and block bounces to find the x at which it
+  // reaches plane_y; returns false if it turns back first.  if it's still bouncing when the depth runs out, the rest
+  // of the path is taken to be straight
+  bool predict_crossing (float plane_y, int depth, float& crossing_x) const {
+    constexpr float kWallX = 0.5f - kBallRadius;
+    auto position = position_;
+    auto velocity = velocity_;
+    for (auto bounce = 0;; ++bounce) {
+      if ((plane_y - position.y) * velocity.y <= 0.0f) return false;
+      auto plane_t = (plane_y - position.y) / velocity.y;
+      if (bounce == depth) {
+        crossing_x = clamp(position.x + velocity.x * plane_t, -0.5f, 0.5f);
+        return true;
+      }
+      auto wall_t = (velocity.x == 0.0f)
+        ? plane_t
+        : std::max(((velocity.x > 0.0f ? kWallX : -kWallX) - position.x) / velocity.x, 0.0f);
+      auto segment_t = std::min(plane_t, wall_t);
+
+      // the sweep works from the view's own position, so a copy stands in for the ball at each stage
+      Ball stage(*this);
+      stage.position_ = position;
+      float toi;
+      vec2 normal;
+      int row, col;
+      if (stage.sweep_blocks(velocity * segment_t, toi, normal, row, col)) {
+        position += velocity * (segment_t * toi);
+        velocity = get_bounce_velocity(velocity, normal);
+
+      } else if (wall_t < plane_t) {
+        position += velocity * wall_t;
+        velocity = get_bounce_velocity(velocity, vec2(velocity.x > 0.0f ? -1.0f : 1.0f, 0.0f));
+
+      } else {
+        crossing_x = position.x + velocity.x * plane_t;
+        return true;
+      }
+    }
+  }
+
+  // pushes two touching balls apart and turns back whichever of them is heading into the other; returns false if
+  // they aren't touching (an earlier contact in the step may have pushed them apart)
+  bool collide (Ball& other) {
+    auto offset = position_ - other.position_;
+    auto distance_squared = offset.length_squared();
+    if (distance_squared >= kBallDiameter * kBallDiameter) return false;
+
+    // balls exactly on top of each other have no normal to speak of, so they're parted vertically
+    auto distance = std::sqrt(distance_squared);
+    auto normal = (distance > 0.0f) ? offset / distance : vec2(0.0f, 1.0f);
+    auto push = normal * ((kBallDiameter - distance) * 0.5f);
+    position_ += push;
+    other.position_ -= push;
+    if (velocity_.dot(normal) < 0.0f) handle_bounce(normal);
+    if (other.velocity_.dot(normal) > 0.0f) other.handle_bounce(-normal);
+    return true;
   }
 
-  void tick (float dt) {
+  // near is what the broad phase found the ball's straight path coming near; a ball that comes near no blocks moves
+  // straight, and one that moves straight can't touch anything else its path didn't come near
+  void tick (float dt, std::uint32_t near) {
     if (attached_) {
-      constexpr float kBallAttachmentOffset = kPaddleWidth * 0.125f;
-      constexpr float kBallAttachmentY = 0.5f / kAspect - kPaddleHeight - kBallRadius;
-      if (player_owned_) position_ = vec2(player_position + kBallAttachmentOffset, -kBallAttachmentY);
-      else position_ = vec2(computer_position - kBallAttachmentOffset, kBallAttachmentY);
+      attach_to_paddle();
+
+    } else if (near & kNearBlocks) {
+      check_collisions(move(dt) ? kNearWall | kNearPaddle : near);
 
     } else {
       position_ += velocity_ * dt;
-      check_collisions();
+      check_collisions(near);
     }
-    ball_program->draw_quad(position_.x, position_.y, kBallDiameter, kBallDiameter);
   }
 
 private:
+  game& game_;
+  ball_pool& balls_;
+  int index_;
   bool player_owned_;
   vec2 position_;
+  vec2 previous_position_;
   vec2 velocity_;
-  bool attached_ = true;
+  bool attached_;
+  bool lost_ = false;
+  bool velocity_changed_ = false;
+
+  void attach_to_paddle () {
+    constexpr float kBallAttachmentOffset = kPaddleWidth * 0.125f;
+    constexpr float kBallAttachmentY = 0.5f / kAspect - kPaddleHeight - kBallRadius;
+    if (player_owned_) position_ = vec2(game_.player_position_ + kBallAttachmentOffset, -kBallAttachmentY);
+    else position_ = vec2(game_.computer_position_ - kBallAttachmentOffset, kBallAttachmentY);
+  }
 
-  void check_collisions () {
-    constexpr float kMaxY = 0.5f / kAspect + kBallRadius;
-    if (position_.y < -kMaxY || position_.y > kMaxY) {
-      attached_ = true;
-      play_loss(player_owned_);
-      return;
+  // advances the ball through the block grid, bouncing off every block it touches along the way; returns whether it
+  // touched any
+  bool move (float dt) {
+    constexpr int kMaxImpacts = 4;
+    auto motion = velocity_ * dt;
+    for (auto impact = 0; impact < kMaxImpacts; ++impact) {
+      float toi;
+      vec2 normal;
+      int row, col;
+      if (!sweep_blocks(motion, toi, normal, row, col)) {
+        position_ += motion;
+        return impact > 0;
+      }
+      position_ += motion * toi;
+      game_.blocks_.clear(row, col);
+      game_.listener_.clear_block(row, col);
+      ++game_.prediction_epoch_;
+      handle_bounce(normal);
+      dt *= 1.0f - toi;
+      motion = velocity_ * dt;
     }
-    // check against blocks
-    auto min_col = clamp((int)((position_.x - kBallRadius + 0.5f) * kFieldCols), 0, kFieldCols - 1);
-    auto max_col = clamp((int)((position_.x + kBallRadius + 0.5f) * kFieldCols), 0, kFieldCols - 1);
+    // out of impacts: drop the rest of the step rather than risk moving through a block
+    return true;
+  }
+
+  // finds the earliest time (as a fraction of motion) at which the ball touches a block, walking the cells along its
+  // path with a DDA traversal and testing only the blocks that newly come within reach at each step
+  bool sweep_blocks (const vec2& motion, float& toi, vec2& normal, int& hit_row, int& hit_col) const {
     constexpr float kHalfHeight = kFieldHeight * 0.5f;
-    constexpr float kFieldRowScale = kFieldRows / kFieldHeight;
-    auto min_row = clamp((int)((position_.y - kBallRadius + kHalfHeight) * kFieldRowScale), 0, kFieldRows - 1);
-    auto max_row = clamp((int)((position_.y + kBallRadius + kHalfHeight) * kFieldRowScale), 0, kFieldRows - 1);
-    for (auto row = min_row; row <= max_row; ++row) {
-      for (auto col = min_col; col <= max_col; ++col) {
-        auto index = row * kFieldCols + col;
-        constexpr float kBlockWidth = 1.0f / kFieldCols;
-        constexpr float kBlockHeight = kFieldHeight / kFieldRows;
-        if (!block_states.test(index)) {
-          if (check_quad_collision(
-              (col + 0.5f) * kBlockWidth - 0.5f,
-              (row + 0.5f) * kBlockHeight - kHalfHeight,
-              kBlockWidth, kBlockHeight)) {
-            block_states.set(index);
-            clear_block(row, col);
-          }
-        }
+    auto& blocks = game_.blocks_;
+    auto block_width = game_.block_width_, block_height = game_.block_height_;
+    auto reach_cols = game_.reach_cols_, reach_rows = game_.reach_rows_;
+    auto rows = blocks.get_rows(), cols = blocks.get_cols();
+
+    // clip the motion to the field expanded by the ball radius
+    auto t_enter = 0.0f, t_exit = 1.0f;
+    if (!clip_axis(position_.x, motion.x, -0.5f - kBallRadius, 0.5f + kBallRadius, t_enter, t_exit) ||
+        !clip_axis(position_.y, motion.y, -kHalfHeight - kBallRadius, kHalfHeight + kBallRadius, t_enter, t_exit)) {
+      return false;
+    }
+
+    auto found = false;
+    toi = 1.0f;
+    auto test_block = [&](int row, int col) {
+      float block_toi;
+      vec2 block_normal;
+      vec2 box_min(col * block_width - 0.5f, row * block_height - kHalfHeight);
+      if (sweep_box(motion, box_min, box_min + vec2(block_width, block_height), block_toi, block_normal) &&
+          block_toi < toi) {
+        toi = block_toi;
+        normal = block_normal;
+        hit_row = row;
+        hit_col = col;
+        found = true;
+      }
+    };
+
+    // when blocks are much smaller than the ball, most of the square neighbourhood the DDA walks lies out of reach,
+    // so first work out which columns of each row the swept circle can actually touch
+    auto end = position_ + motion;
+    auto min_x = std::min(position_.x, end.x), max_x = std::max(position_.x, end.x);
+    auto min_y = std::min(position_.y, end.y), max_y = std::max(position_.y, end.y);
+    auto first_row = clamp((int)std::floor((min_y - kBallRadius + kHalfHeight) / block_height), 0, rows - 1);
+    auto last_row = clamp((int)std::floor((max_y + kBallRadius + kHalfHeight) / block_height), 0, rows - 1);
+    auto& reachable_cols = game_.reachable_cols_;
+    reachable_cols.resize((last_row - first_row + 1) * 2);
+    for (auto row = first_row; row <= last_row; ++row) {
+      auto row_min_y = row * block_height - kHalfHeight;
+      auto dy = std::max(0.0f, std::max(row_min_y - max_y, min_y - (row_min_y + block_height)));
+      auto span = &reachable_cols[(row - first_row) * 2];
+      if (dy >= kBallRadius) {
+        span[0] = cols;
+        span[1] = -1;
+        continue;
       }
+      auto half_width = std::sqrt(kBallRadius * kBallRadius - dy * dy);
+      span[0] = clamp((int)std::floor((min_x - half_width + 0.5f) * cols), 0, cols - 1);
+      span[1] = clamp((int)std::floor((max_x + half_width + 0.5f) * cols), 0, cols - 1);
     }
 
-    // check against left and right walls
-    check_segment_collision(vec2(-0.5f, -kMaxY), vec2(-0.5f, kMaxY));
-    check_segment_collision(vec2(0.5f, kMaxY), vec2(0.5f, -kMaxY));
+    // the row bitmaps let us skip straight to the blocks that remain
+    auto test_row_span = [&](int row, int min_col, int max_col) {
+      if (row < first_row || row > last_row) return;
+      auto span = &reachable_cols[(row - first_row) * 2];
+      min_col = std::max(min_col, span[0]);
+      max_col = std::min(max_col, span[1]);
+      if (min_col > max_col) return;
+      blocks.for_each_in_row(row, min_col, max_col, [&](int col) { test_block(row, col); });
+    };
+    auto test_col_span = [&](int col, int min_row, int max_row) {
+      for (auto row = std::max(min_row, first_row), end_row = std::min(max_row, last_row); row <= end_row; ++row) {
+        auto span = &reachable_cols[(row - first_row) * 2];
+        if (col >= span[0] && col <= span[1] && blocks.test(row, col)) test_block(row, col);
+      }
+    };
+
+    // grid coordinates and per-unit-time deltas
+    auto start = position_ + motion * t_enter;
+    auto grid_x = (start.x + 0.5f) * cols;
+    auto grid_y = (start.y + kHalfHeight) / block_height;
+    auto grid_dx = motion.x * cols;
+    auto grid_dy = motion.y / block_height;
+    auto col = (int)std::floor(grid_x);
+    auto row = (int)std::floor(grid_y);
+    auto step_col = (grid_dx < 0.0f) ? -1 : 1;
+    auto step_row = (grid_dy < 0.0f) ? -1 : 1;
+    constexpr float kInfinity = std::numeric_limits<float>::infinity();
+    auto t_delta_x = (grid_dx == 0.0f) ? kInfinity : std::abs(1.0f / grid_dx);
+    auto t_delta_y = (grid_dy == 0.0f) ? kInfinity : std::abs(1.0f / grid_dy);
+    auto t_max_x = (grid_dx == 0.0f) ? kInfinity : t_enter + (col + (step_col > 0) - grid_x) / grid_dx;
+    auto t_max_y = (grid_dy == 0.0f) ? kInfinity : t_enter + (row + (step_row > 0) - grid_y) / grid_dy;
+
+    for (auto r = row - reach_rows; r <= row + reach_rows; ++r) test_row_span(r, col - reach_cols, col + reach_cols);
+    while (true) {
+      // any block we could touch before entering the next cell has already been tested, so we can stop as soon as
+      // the next cell lies beyond the earliest impact
+      if (t_max_x < t_max_y) {
+        if (t_max_x > t_exit || t_max_x >= toi) break;
+        col += step_col;
+        t_max_x += t_delta_x;
+        test_col_span(col + step_col * reach_cols, row - reach_rows, row + reach_rows);
+
+      } else {
+        if (t_max_y > t_exit || t_max_y >= toi) break;
+        row += step_row;
+        t_max_y += t_delta_y;
+        test_row_span(row + step_row * reach_rows, col - reach_cols, col + reach_cols);
+      }
+    }
+    return found;
+  }
 
-    // check against paddles
-    check_paddle_collision(computer_position, kPaddleY);
-    check_paddle_collision(player_position, -kPaddleY);
+  // finds the time (as a fraction of motion) at which the ball first touches the box, treating it as a ray cast
+  // against the box rounded by the ball radius
+  bool sweep_box (const vec2& motion, const vec2& box_min, const vec2& box_max, float& toi, vec2& normal) const {
+    // if we're already touching, it only counts as an impact if we're moving further in
+    vec2 closest(clamp(position_.x, box_min.x, box_max.x), clamp(position_.y, box_min.y, box_max.y));
+    auto offset = position_ - closest;
+    auto distance_squared = offset.length_squared();
+    if (distance_squared < kBallRadius * kBallRadius) {
+      if (distance_squared > 0.0f) {
+        normal = offset / std::sqrt(distance_squared);
+      } else {
+        // center inside the box: push out along the axis of least penetration
+        auto left = position_.x - box_min.x, right = box_max.x - position_.x;
+        auto bottom = position_.y - box_min.y, top = box_max.y - position_.y;
+        auto min_x = std::min(left, right), min_y = std::min(bottom, top);
+        normal = (min_x < min_y)
+          ? vec2(left < right ? -1.0f : 1.0f, 0.0f)
+          : vec2(0.0f, bottom < top ? -1.0f : 1.0f);
+      }
+      if (motion.dot(normal) >= 0.0f) return false;
+      toi = 0.0f;
+      return true;
+    }
+
+    // slab test against the box expanded by the radius
+    auto t_enter = 0.0f, t_exit = 1.0f;
+    auto enter_axis = -1;
+    const float starts[] {position_.x, position_.y};
+    const float deltas[] {motion.x, motion.y};
+    const float mins[] {box_min.x - kBallRadius, box_min.y - kBallRadius};
+    const float maxes[] {box_max.x + kBallRadius, box_max.y + kBallRadius};
+    for (auto axis = 0; axis < 2; ++axis) {
+      auto axis_enter = t_enter;
+      if (!clip_axis(starts[axis], deltas[axis], mins[axis], maxes[axis], axis_enter, t_exit)) return false;
+      if (axis_enter > t_enter) {
+        t_enter = axis_enter;
+        enter_axis = axis;
+      }
+    }
+    auto point = position_ + motion * t_enter;
+    if (enter_axis == 0 && point.y >= box_min.y && point.y <= box_max.y) {
+      toi = t_enter;
+      normal = vec2(motion.x > 0.0f ? -1.0f : 1.0f, 0.0f);
+      return true;
+    }
+    if (enter_axis == 1 && point.x >= box_min.x && point.x <= box_max.x) {
+      toi = t_enter;
+      normal = vec2(0.0f, motion.y > 0.0f ? -1.0f : 1.0f);
+      return true;
+    }
+
+    // entered through a corner region, so the rounded corner is the only thing we can hit
+    vec2 corner(point.x < box_min.x ? box_min.x : box_max.x, point.y < box_min.y ? box_min.y : box_max.y);
+    auto corner_offset = position_ - corner;
+    auto a = motion.length_squared();
+    auto b = motion.dot(corner_offset);
+    auto c = corner_offset.length_squared() - kBallRadius * kBallRadius;
+    auto discriminant = b * b - a * c;
+    if (a == 0.0f || discriminant < 0.0f) return false;
+    auto t = (-b - std::sqrt(discriminant)) / a;
+    if (t < 0.0f || t > 1.0f) return false;
+    toi = t;
+    normal = (corner_offset + motion * t) / kBallRadius;
+    return true;
+  }
+
+  // narrows [t_enter, t_exit] to the times at which start + delta * t lies within [min, max]
+  static bool clip_axis (float start, float delta, float min, float max, float& t_enter, float& t_exit) {
+    if (delta == 0.0f) return start >= min && start <= max;
+    auto t0 = (min - start) / delta, t1 = (max - start) / delta;
+    if (t0 > t1) std::swap(t0, t1);
+    t_enter = std::max(t_enter, t0);
+    t_exit = std::min(t_exit, t1);
+    return t_enter <= t_exit;
   }
 
-  bool check_quad_collision (float x, float y, float w, float h) {
-    float hw = w * 0.5f, hh = h * 0.5f;
-    return
-      check_segment_collision(vec2(x - hw, y - hh), vec2(x + hw, y - hh)) |
-      check_segment_collision(vec2(x + hw, y - hh), vec2(x + hw, y + hh)) |
-      check_segment_collision(vec2(x + hw, y + hh), vec2(x - hw, y + hh)) |
-      check_segment_collision(vec2(x - hw, y + hh), vec2(x - hw, y - hh));
+  // the paddles lie between the field and the ends a ball is lost through, so a ball not near them can't be lost
+  void check_collisions (std::uint32_t near) {
+    constexpr float kMaxY = 0.5f / kAspect + kBallRadius;
+    if ((near & kNearPaddle) && (position_.y < -kMaxY || position_.y > kMaxY)) {
+      game_.listener_.play_loss(index_);
+      if (index_ >= kOwnedBallCount) {
+        lost_ = true;
+        return;
+      }
+      attached_ = true;
+
+      // snap straight back to the paddle so that rendering doesn't interpolate across the field
+      attach_to_paddle();
+      previous_position_ = position_;
+      return;
+    }
+    // check against left and right walls
+    if (near & kNearWall) {
+      check_segment_collision(vec2(-0.5f, -kMaxY), vec2(-0.5f, kMaxY));
+      check_segment_collision(vec2(0.5f, kMaxY), vec2(0.5f, -kMaxY));
+    }
+
+    // check against paddles
+    if (near & kNearPaddle) {
+      check_paddle_collision(game_.computer_position_, kPaddleY);
+      check_paddle_collision(game_.player_position_, -kPaddleY);
+    }
   }
 
   bool check_segment_collision (const vec2& a, const vec2& b) {
@@ -158,13 +410,14 @@ private:
     else if (dir_dot > length_squared) closest = b;
     else closest = a + ab * (dir_dot / length_squared); 
 
+    // most balls are nowhere near, so rule them out before taking a square root
     normal = position_ - closest;
-    auto length = normal.length();
-    auto penetration = kBallRadius - length;
-    if (penetration <= 0.0f) return false;
+    auto length_squared_to_closest = normal.length_squared();
+    if (length_squared_to_closest >= kBallRadius * kBallRadius) return false;
+    auto length = std::sqrt(length_squared_to_closest);
     normal /= length;
-    position_ += normal * penetration;
-    
+    position_ += normal * (kBallRadius - length);
+
     handle_bounce(normal);
     return true;
   }
@@ -182,18 +435,20 @@ private:
     else if (dir_dot > length_squared) closest = b;
     else closest = a + ab * (dir_dot / length_squared);
 
-    auto normal = position_ - closest;
-    auto length = normal.length();
-    auto penetration = kBallRadius + kPaddleHeight * 0.5f - length;
-    if (penetration <= 0.0f) return;
-    normal /= length;
+    constexpr float kContactDistance = kBallRadius + kPaddleHeight * 0.5f;
+    auto offset = position_ - closest;
+    auto length_squared_to_closest = offset.length_squared();
+    if (length_squared_to_closest >= kContactDistance * kContactDistance) return;
+    auto length = std::sqrt(length_squared_to_closest);
     auto rel_pos = position_ - vec2(x, y);
-    position_ += normal * penetration;
+
+    // the offset only needs normalizing to push the ball out, which scaling it by the penetration does in one go
+    position_ += offset * ((kContactDistance - length) / length);
 
     // for aim control purposes, treat the bounce normals as if the paddle were ellipsoidal
     constexpr float kNormalRadius = kPaddleWidth * 0.5f + kBallRadius;
     constexpr float kNormalScale = 0.25f;
-    normal = vec2(
+    auto normal = vec2(
       rel_pos.x,
       std::sqrt(kNormalRadius * kNormalRadius - rel_pos.x * rel_pos.x) * (rel_pos.y > 0.0f ? 1.0f : -1.0f) / kNormalScale);
 
@@ -201,78 +456,380 @@ private:
   }
 
   void handle_bounce (const vec2& normal) {
-    auto direction = (-velocity_).reflect(normal).normalize();
-    constexpr float kMinAngle = M_PI / 16;
-    auto max_cos = std::cos(kMinAngle);
-    if (std::abs(direction.x) > max_cos) {
-      direction.x = (direction.x < 0.0f) ? -max_cos : max_cos;
-      auto max_sin = std::sin(kMinAngle);
-      direction.y = (direction.y < 0.0f) ? -max_sin : max_sin;
+    velocity_ = get_bounce_velocity(velocity_, normal);
+    velocity_changed_ = true;
+
+    game_.listener_.play_bounce(index_);
+  }
+
+  static vec2 get_bounce_velocity (const vec2& velocity, const vec2& normal) {
+    auto direction = (-velocity).reflect(normal).normalize();
+    if (std::abs(direction.x) > kMinBounceCos) {
+      direction.x = (direction.x < 0.0f) ? -kMinBounceCos : kMinBounceCos;
+      direction.y = (direction.y < 0.0f) ? -kMinBounceSin : kMinBounceSin;
     }
-    velocity_ = direction * kBallSpeed;
+    return direction * kBallSpeed;
+  }
+};
+
+game::game (game_listener& listener, unsigned seed) : listener_(listener), engine_(seed) {
+  fill_field(kDefaultFieldRows, kDefaultFieldCols);
+  reset();
+}
+
+void game::reset () {
+  computer_position_ = 0.0f;
+  player_position_ = 0.0f;
+  previous_computer_position_ = 0.0f;
+  fill_field(blocks_.get_rows(), blocks_.get_cols());
+  balls_.clear();
+  balls_.add(0.0f, 0.0f, 0.0f, 0.0f, kBallAttached);
+  balls_.add(0.0f, 0.0f, 0.0f, 0.0f, kBallAttached | kBallPlayerOwned);
+  for (auto& state : computer_states_) state = computer_state();
+}
+
+void game::set_player_position (float position) {
+  player_position_ = clamp(position, -kMaxPaddleX, kMaxPaddleX);
+}
+
+void game::set_opponent_position (float position) {
+  computer_position_ = clamp(position, -kMaxPaddleX, kMaxPaddleX);
+}
+
+void game::set_prediction_depth (int side, int depth) {
+  prediction_depths_[side] = std::max(depth, 0);
+  ++prediction_epoch_;
+}
 
-    play_bounce(player_owned_);
+void game::set_field_size (int rows, int cols) {
+  fill_field(clamp(rows, 1, kMaxFieldRows), clamp(cols, 1, kMaxFieldCols));
+}
+
+int game::spawn_ball (float x, float y, float vx, float vy, int owner) {
+  return balls_.add(x, y, vx, vy, (owner == kPlayerBallIndex) ? kBallPlayerOwned : 0);
+}
+
+void game::maybe_release_player_ball () {
+  Ball ball(*this, kPlayerBallIndex);
+  ball.maybe_release();
+  ball.store();
+}
+
+void game::maybe_release_opponent_ball () {
+  Ball ball(*this, kComputerBallIndex);
+  ball.maybe_release();
+  ball.store();
+}
+
+void game::save_state (snapshot& out) const {
+  auto& scalars = out.scalars_;
+  scalars.computer_position = computer_position_;
+  scalars.player_position = player_position_;
+  scalars.previous_computer_position = previous_computer_position_;
+  scalars.player_autopilot = player_autopilot_;
+  scalars.opponent_human = opponent_human_;
+  std::copy(std::begin(computer_states_), std::end(computer_states_), scalars.computer_states);
+  scalars.engine = engine_;
+  scalars.prediction_epoch = prediction_epoch_;
+  std::copy(std::begin(prediction_depths_), std::end(prediction_depths_), scalars.prediction_depths);
+  out.balls_ = balls_;
+  out.blocks_ = blocks_;
+}
+
+void game::load_state (const snapshot& in) {
+  auto& scalars = in.scalars_;
+  computer_position_ = scalars.computer_position;
+  player_position_ = scalars.player_position;
+  previous_computer_position_ = scalars.previous_computer_position;
+  player_autopilot_ = scalars.player_autopilot;
+  opponent_human_ = scalars.opponent_human;
+  std::copy(std::begin(scalars.computer_states), std::end(scalars.computer_states), computer_states_);
+  engine_ = scalars.engine;
+  prediction_epoch_ = scalars.prediction_epoch;
+  std::copy(std::begin(scalars.prediction_depths), std::end(scalars.prediction_depths), prediction_depths_);
+  balls_ = in.balls_;
+  auto resized = blocks_.get_rows() != in.blocks_.get_rows() || blocks_.get_cols() != in.blocks_.get_cols();
+  blocks_ = in.blocks_;
+  if (resized) update_block_metrics();
+}
+
+std::uint64_t game::get_state_hash () const {
+  fnv_hasher hasher;
+  hasher.add(computer_position_);
+  hasher.add(player_position_);
+  for (auto& state : computer_states_) {
+    hasher.add(state.target_position);
+    hasher.add(state.target_position_initialized);
+  }
+  auto count = balls_.size();
+  hasher.add(count);
+  for (auto array : {&balls_.x, &balls_.y, &balls_.vx, &balls_.vy}) hasher.add(*array, count);
+  hasher.add(balls_.flags, count);
+  hasher.add(blocks_.get_rows());
+  hasher.add(blocks_.get_cols());
+  hasher.add(blocks_.get_block_count());
+  for (auto row = 0, rows = blocks_.get_rows(), cols = blocks_.get_cols(); row < rows; ++row) {
+    blocks_.for_each_in_row(row, 0, cols - 1, [&](int col) { hasher.add(row * cols + col); });
+  }
+  return hasher.get();
+}
+
+void game::tick (float dt) {
+  PROFILE_ZONE("tick");
+  previous_computer_position_ = computer_position_;
+  if (!opponent_human_) tick_computer(dt, kComputerBallIndex, computer_position_);
+  if (player_autopilot_) tick_computer(dt, kPlayerBallIndex, player_position_);
+
+  // free balls clear of everything move in the vectorized broad phase; the rest go through the narrow phase one at a
+  // time, walking backwards so that removing a lost ball (which moves the last ball into its slot) can't skip any
+  {
+    PROFILE_ZONE("integrate");
+    balls_.integrate(dt, kBallRadius, get_ball_bounds(), ball_candidates_);
+  }
+  PROFILE_ZONE("narrow_phase");
+  for (auto it = ball_candidates_.rbegin(); it != ball_candidates_.rend(); ++it) {
+    Ball ball(*this, it->index);
+    ball.tick(dt, it->near);
+    if (ball.is_lost()) balls_.remove(it->index);
+    else ball.store();
+  }
+  PROFILE_COUNT("narrow phase balls", (long)ball_candidates_.size());
+  collide_balls();
+}
+
+// resolves contacts between free balls once they've all moved, in the order the grid finds them (which depends only
+// on the state), so that the outcome is deterministic
+void game::collide_balls () {
+  ball_pairs_tested_ = 0;
+  ball_contacts_ = 0;
+  auto resolve = [&](int first, int second) {
+    Ball a(*this, first), b(*this, second);
+    if (!a.collide(b)) return;
+    a.store();
+    b.store();
+    ++ball_contacts_;
+  };
+
+  // the usual game has two balls, often with one on a paddle; those are tested directly rather than through the grid
+  int free_balls[2];
+  auto free_count = 0;
+  for (auto ball = 0, count = balls_.size(); ball < count && free_count <= 2; ++ball) {
+    if (balls_.flags[ball] & kBallAttached) continue;
+    if (free_count < 2) free_balls[free_count] = ball;
+    ++free_count;
   }
-} balls[] {false, true};
-
-void tick_computer (float dt) {
-  static float target_position = 0.0f;
-  auto& own_ball = balls[kComputerBallIndex];
-  if (own_ball.is_attached()) {
-    static bool target_position_initialized = false;
-    if (!target_position_initialized) {
-      static std::default_random_engine engine(std::chrono::system_clock::now().time_since_epoch().count());
-      target_position = std::uniform_real_distribution<float>(-kMaxPaddleX, kMaxPaddleX)(engine);
-      target_position_initialized = true;
+  if (free_count < 2) return;
+  if (free_count == 2) {
+    ball_pairs_tested_ = 1;
+    auto dx = balls_.x[free_balls[1]] - balls_.x[free_balls[0]];
+    auto dy = balls_.y[free_balls[1]] - balls_.y[free_balls[0]];
+    if (dx * dx + dy * dy < kBallDiameter * kBallDiameter) resolve(free_balls[0], free_balls[1]);
+    return;
+  }
+
+  PROFILE_ZONE("ball_contacts");
+  ball_grid_.build(balls_);
+  ball_pairs_tested_ = ball_grid_.find_pairs(kBallDiameter, ball_pairs_);
+  for (auto& pair : ball_pairs_) resolve(pair.a, pair.b);
+  PROFILE_COUNT("ball pairs tested", ball_pairs_tested_);
+  PROFILE_COUNT("ball contacts", ball_contacts_);
+}
+
+void game::fill_field (int rows, int cols) {
+  blocks_.reset(rows, cols);
+  update_block_metrics();
+}
+
+void game::update_block_metrics () {
+  block_width_ = 1.0f / blocks_.get_cols();
+  block_height_ = kFieldHeight / blocks_.get_rows();
+  reach_cols_ = (int)(kBallRadius / block_width_) + 1;
+  reach_rows_ = (int)(kBallRadius / block_height_) + 1;
+}
+
+ball_bounds game::get_ball_bounds () const {
+  // the rows that still hold blocks bound the band in which the broad phase has to hand balls to the sweep
+  constexpr float kHalfHeight = kFieldHeight * 0.5f;
+  return {
+    0.5f,
+    kPaddleY - kPaddleHeight * 0.5f,
+    blocks_.get_first_row() * block_height_ - kHalfHeight,
+    (blocks_.get_last_row() + 1) * block_height_ - kHalfHeight};
+}
+
+// moves the paddle owning the specified ball; the player's side is handled by mirroring y
+void game::tick_computer (float dt, int ball_index, float& position) {
+  PROFILE_ZONE("tick_computer");
+  auto& state = computer_states_[ball_index];
+  if (balls_.flags[ball_index] & kBallAttached) {
+    if (!state.target_position_initialized) {
+      state.target_position = std::uniform_real_distribution<float>(-kMaxPaddleX, kMaxPaddleX)(engine_);
+      state.target_position_initialized = true;
     }
-    if (computer_position == target_position) {
+    if (position == state.target_position) {
+      Ball own_ball(*this, ball_index);
       own_ball.maybe_release();
-      target_position_initialized = false;
+      own_ball.store();
+      state.target_position_initialized = false;
     }
   } else {
-    auto it = std::max_element(std::begin(balls), std::end(balls), [](auto& a, auto& b) {
-      return
-        (a.get_position().y > 0.0f) < (b.get_position().y > 0.0f) || // on our side
-        (a.get_velocity().y > 0.0f) < (b.get_velocity().y > 0.0f) || // approaching us
-        a.get_position().y < b.get_position().y; // closer
-    });
-    target_position = it->get_position().x;
+    auto side = (ball_index == kComputerBallIndex) ? 1.0f : -1.0f;
+    auto depth = prediction_depths_[ball_index];
+    auto first = (depth > 0) ? find_first_arrival(side) : -1;
+    if (first != -1) {
+      state.target_position = get_predicted_x(first, side, depth);
+
+    } else {
+      // nothing's headed our way (or we're not looking ahead), so just follow the likeliest ball
+      auto less_threatening = [=](int a, int b) {
+        auto ay = balls_.y[a] * side, by = balls_.y[b] * side;
+        auto avy = balls_.vy[a] * side, bvy = balls_.vy[b] * side;
+        return
+          (ay > 0.0f) < (by > 0.0f) || // on our side
+          (avy > 0.0f) < (bvy > 0.0f) || // approaching us
+          ay < by; // closer
+      };
+      auto target = 0;
+      for (auto ball = 1; ball < balls_.size(); ++ball) {
+        if (less_threatening(target, ball)) target = ball;
+      }
+      state.target_position = balls_.x[target];
+    }
   }
   constexpr float kComputerSpeed = 0.35f;
-  auto velocity = (computer_position < target_position) ? kComputerSpeed : -kComputerSpeed;
-  computer_position = (computer_position < target_position)
-    ? std::min(computer_position + kComputerSpeed * dt, target_position)
-    : std::max(computer_position - kComputerSpeed * dt, target_position);
-  computer_position = clamp(computer_position, -kMaxPaddleX, kMaxPaddleX);
+  position = (position < state.target_position)
+    ? std::min(position + kComputerSpeed * dt, state.target_position)
+    : std::max(position - kComputerSpeed * dt, state.target_position);
+  position = clamp(position, -kMaxPaddleX, kMaxPaddleX);
+}
+
+// the free ball that will reach the side's paddle soonest (going by its current velocity), or -1 if none is headed
+// that way
+int game::find_first_arrival (float side) const {
+  constexpr float kPlaneY = kPaddleY - kPaddleHeight * 0.5f - kBallRadius;
+  auto first = -1;
+  auto first_time = std::numeric_limits<float>::infinity();
+  for (auto ball = 0; ball < balls_.size(); ++ball) {
+    auto vy = balls_.vy[ball] * side;
+    if ((balls_.flags[ball] & kBallAttached) || vy <= 0.0f) continue;
+    auto time = (kPlaneY - balls_.y[ball] * side) / vy;
+    if (time < first_time) {
+      first = ball;
+      first_time = time;
+    }
+  }
+  return first;
 }
 
+// where the ball will reach the side's paddle, worked out afresh only when its cached prediction has gone stale
+float game::get_predicted_x (int ball, float side, int depth) {
+  constexpr float kPlaneY = kPaddleY - kPaddleHeight * 0.5f - kBallRadius;
+  if (balls_.prediction_stamps[ball] != prediction_epoch_) {
+    float crossing_x;
+    auto predicted = Ball(*this, ball).predict_crossing(kPlaneY * side, depth, crossing_x);
+    balls_.predicted_x[ball] = predicted ? crossing_x : std::numeric_limits<float>::quiet_NaN();
+    balls_.prediction_stamps[ball] = prediction_epoch_;
+  }
+  // a ball that turns back before reaching us gets followed instead
+  auto x = balls_.predicted_x[ball];
+  return std::isnan(x) ? balls_.x[ball] : x;
+}
+
+namespace {
+
+// hands the shared game's events to whichever listener the frontend has set, if any
+class frontend_listener : public game_listener {
+public:
+  game_listener* target = nullptr;
+
+  void clear_block (int row, int col) override { if (target) target->clear_block(row, col); }
+  void restore_block (int row, int col) override { if (target) target->restore_block(row, col); }
+
+  void play_launch (int ball) override { if (target) target->play_launch(ball); }
+  void play_bounce (int ball) override { if (target) target->play_bounce(ball); }
+  void play_loss (int ball) override { if (target) target->play_loss(ball); }
+} frontend;
+
+game shared_game(frontend, std::chrono::system_clock::now().time_since_epoch().count());
+
+}
+
+void set_game_listener (game_listener* listener) {
+  frontend.target = listener;
+}
+
+void reset_game () {
+  shared_game.reset();
+}
+
+void seed_game (unsigned seed) {
+  shared_game.seed(seed);
 }
 
 void set_player_position (float position) {
-  player_position = clamp(position, -kMaxPaddleX, kMaxPaddleX);
+  shared_game.set_player_position(position);
 }
 
 float get_player_position () {
-  return player_position;
+  return shared_game.get_player_position();
+}
+
+float get_computer_position (float alpha) {
+  return shared_game.get_computer_position(alpha);
+}
+
+void set_player_autopilot (bool enabled) {
+  shared_game.set_player_autopilot(enabled);
+}
+
+void set_field_size (int rows, int cols) {
+  shared_game.set_field_size(rows, cols);
+}
+
+int get_field_rows () {
+  return shared_game.get_field_rows();
+}
+
+int get_field_cols () {
+  return shared_game.get_field_cols();
 }
 
 bool get_block_state (int row, int col) {
-  return block_states.test(row * kFieldCols + col);
+  return shared_game.get_block_state(row, col);
 }
 
-void maybe_release_player_ball () {
-  balls[kPlayerBallIndex].maybe_release();
+int get_ball_count () {
+  return shared_game.get_ball_count();
 }
 
-void tick (float dt) {
-  backdrop_program->draw_quad(0.0f, 0.0f, 1.0f, 1.0f / kAspect);
+int get_ball_owner (int ball) {
+  return shared_game.get_ball_owner(ball);
+}
 
-  tick_computer(dt);
+float get_ball_x (int ball, float alpha) {
+  return shared_game.get_ball_x(ball, alpha);
+}
 
-  paddle_program->draw_quad(computer_position, kPaddleY, kPaddleWidth, kPaddleHeight);
-  paddle_program->draw_quad(player_position, -kPaddleY, kPaddleWidth, kPaddleHeight);
+float get_ball_y (int ball, float alpha) {
+  return shared_game.get_ball_y(ball, alpha);
+}
 
-  blocks_program->draw_quad(0.0f, 0.0f, 1.0f, kFieldHeight);
+int spawn_ball (float x, float y, float vx, float vy, int owner) {
+  return shared_game.spawn_ball(x, y, vx, vy, owner);
+}
 
-  for (auto& ball : balls) ball.tick(dt);
-}
\ No newline at end of file
+void maybe_release_player_ball () {
+  shared_game.maybe_release_player_ball();
+}
+
+void tick (float dt) {
+  shared_game.tick(dt);
+}
+
+std::uint64_t get_game_state_hash () {
+  return shared_game.get_state_hash();
+}
+
+const game& get_shared_game () {
+  return shared_game;
+}
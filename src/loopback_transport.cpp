@@ -0,0 +1,30 @@
+#include <algorithm>
+
+#include "loopback_transport.hpp"
+
+loopback_link::loopback_link (const loopback_conditions& conditions, unsigned seed) :
+    conditions_(conditions),
+    engine_(seed) {}
+
+void loopback_link::end::send (const unsigned char* data, std::size_t size) {
+  auto& link = link_;
+  ++link.packets_sent_;
+  if (std::bernoulli_distribution(link.conditions_.loss)(link.engine_)) {
+    ++link.packets_dropped_;
+    return;
+  }
+  auto jitter = std::uniform_real_distribution<double>(-link.conditions_.jitter, link.conditions_.jitter)(link.engine_);
+  auto delay = std::max(link.conditions_.latency + jitter, 0.0);
+  link.in_flight_[1 - index_].push_back({link.time_ + delay, std::vector<unsigned char>(data, data + size)});
+}
+
+bool loopback_link::end::receive (std::vector<unsigned char>& data) {
+  // the earliest packet due, so that jitter reorders them as a real network would
+  auto& in_flight = link_.in_flight_[index_];
+  auto by_delivery = [](const packet& a, const packet& b) { return a.delivery_time < b.delivery_time; };
+  auto next = std::min_element(in_flight.begin(), in_flight.end(), by_delivery);
+  if (next == in_flight.end() || next->delivery_time > link_.time_) return false;
+  data.swap(next->data);
+  in_flight.erase(next);
+  return true;
+}
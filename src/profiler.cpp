@@ -0,0 +1,189 @@
+#include "profiler.hpp"
+
+#ifdef PROFILER_ENABLED
+
+#include <algorithm>
+#include <chrono>
+#include <limits>
+#include <memory>
+#include <mutex>
+
+namespace profiler {
+
+namespace {
+
+constexpr int kRingSize = 1 << 16;
+constexpr int kHistorySize = 240;
+
+struct event {
+  const char* name;
+  std::int64_t start;
+  std::int64_t end;
+};
+
+struct counter_sample {
+  const char* name;
+  std::int64_t time;
+  long value;
+};
+
+// a zone or counter's per-frame values over the last kHistorySize frames
+struct series {
+  const char* name;
+  bool counter;
+  double current = 0.0;
+  std::vector<float> history;
+};
+
+struct thread_buffer {
+  int id;
+  std::vector<event> events;
+  std::uint64_t event_count = 0;
+  std::vector<counter_sample> counter_samples;
+  std::uint64_t counter_sample_count = 0;
+
+  // only this buffer's thread touches the series, but other threads may read their names and histories (never the
+  // current values) for the stats: adding a series and ending a frame hold the lock, so those stay consistent
+  std::mutex series_mutex;
+  std::vector<series> frame_series;
+  std::int64_t frame_start;
+  int frame_count = 0;
+
+  series& get_series (const char* name, bool counter) {
+    // names are literals, so comparing pointers is enough; there are only ever a handful
+    for (auto& existing : frame_series) {
+      if (existing.name == name) return existing;
+    }
+    std::lock_guard<std::mutex> lock(series_mutex);
+    frame_series.push_back({name, counter, 0.0, std::vector<float>(kHistorySize, 0.0f)});
+    return frame_series.back();
+  }
+};
+
+std::mutex buffers_mutex;
+
+// kept around after their threads exit, so that their events can still be exported
+std::vector<std::shared_ptr<thread_buffer>> buffers;
+
+std::int64_t now () {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+    std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+thread_buffer& get_buffer () {
+  thread_local thread_buffer* current = nullptr;
+  if (!current) {
+    auto buffer = std::make_shared<thread_buffer>();
+    buffer->events.resize(kRingSize);
+    buffer->counter_samples.resize(kRingSize);
+    buffer->frame_start = now();
+    std::lock_guard<std::mutex> lock(buffers_mutex);
+    buffer->id = (int)buffers.size() + 1;
+    buffers.push_back(buffer);
+    current = buffer.get();
+  }
+  return *current;
+}
+
+float percentile (std::vector<float>& values, float fraction) {
+  auto nth = values.begin() + std::min((int)(values.size() * fraction), (int)values.size() - 1);
+  std::nth_element(values.begin(), nth, values.end());
+  return *nth;
+}
+
+}
+
+zone::zone (const char* name) : name_(name), start_(now()) {}
+
+zone::~zone () {
+  auto end = now();
+  auto& buffer = get_buffer();
+  buffer.events[buffer.event_count++ % kRingSize] = {name_, start_, end};
+  buffer.get_series(name_, false).current += (end - start_) * 1e-6;
+}
+
+void count (const char* name, long value) {
+  auto& buffer = get_buffer();
+  buffer.get_series(name, true).current += value;
+}
+
+void end_frame () {
+  auto& buffer = get_buffer();
+  auto end = now();
+  buffer.get_series("frame", false).current = (end - buffer.frame_start) * 1e-6;
+  buffer.frame_start = end;
+  std::lock_guard<std::mutex> lock(buffer.series_mutex);
+  auto slot = buffer.frame_count++ % kHistorySize;
+  for (auto& series : buffer.frame_series) {
+    series.history[slot] = (float)series.current;
+    if (series.counter) {
+      buffer.counter_samples[buffer.counter_sample_count++ % kRingSize] = {series.name, end, (long)series.current};
+    }
+    series.current = 0.0;
+  }
+}
+
+std::vector<series_stats> get_frame_stats () {
+  auto& own = get_buffer();
+  std::vector<series_stats> stats;
+  std::vector<float> values;
+  auto add_stats = [&](thread_buffer& buffer, int thread) {
+    std::lock_guard<std::mutex> lock(buffer.series_mutex);
+    auto frames = std::min(buffer.frame_count, kHistorySize);
+    if (frames == 0) return;
+    for (auto& series : buffer.frame_series) {
+      values.assign(series.history.begin(), series.history.begin() + frames);
+      stats.push_back({series.name, series.counter, thread, percentile(values, 0.5f), percentile(values, 0.9f),
+        percentile(values, 0.99f)});
+    }
+  };
+
+  std::lock_guard<std::mutex> lock(buffers_mutex);
+  add_stats(own, 0);
+  for (auto& buffer : buffers) {
+    if (buffer.get() != &own) add_stats(*buffer, buffer->id);
+  }
+  return stats;
+}
+
+void write_trace (std::ostream& out) {
+  std::lock_guard<std::mutex> lock(buffers_mutex);
+
+  // timestamps are in microseconds, relative to the earliest event we still have
+  auto origin = std::numeric_limits<std::int64_t>::max();
+  for (auto& buffer : buffers) {
+    auto first = buffer->event_count > kRingSize ? buffer->event_count - kRingSize : 0;
+    for (auto index = first; index < buffer->event_count; ++index) {
+      origin = std::min(origin, buffer->events[index % kRingSize].start);
+    }
+    first = buffer->counter_sample_count > kRingSize ? buffer->counter_sample_count - kRingSize : 0;
+    for (auto index = first; index < buffer->counter_sample_count; ++index) {
+      origin = std::min(origin, buffer->counter_samples[index % kRingSize].time);
+    }
+  }
+  auto microseconds = [&](std::int64_t time) { return (time - origin) * 1e-3; };
+
+  out << "{\"traceEvents\":[";
+  auto separator = "\n";
+  for (auto& buffer : buffers) {
+    auto first = buffer->event_count > kRingSize ? buffer->event_count - kRingSize : 0;
+    for (auto index = first; index < buffer->event_count; ++index) {
+      auto& event = buffer->events[index % kRingSize];
+      out << separator << "{\"name\":\"" << event.name << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << buffer->id <<
+        ",\"ts\":" << microseconds(event.start) << ",\"dur\":" << (event.end - event.start) * 1e-3 << "}";
+      separator = ",\n";
+    }
+    first = buffer->counter_sample_count > kRingSize ? buffer->counter_sample_count - kRingSize : 0;
+    for (auto index = first; index < buffer->counter_sample_count; ++index) {
+      auto& sample = buffer->counter_samples[index % kRingSize];
+      out << separator << "{\"name\":\"" << sample.name << "\",\"ph\":\"C\",\"pid\":1,\"tid\":" << buffer->id <<
+        ",\"ts\":" << microseconds(sample.time) << ",\"args\":{\"value\":" << sample.value << "}}";
+      separator = ",\n";
+    }
+  }
+  out << "\n]}\n";
+}
+
+}
+
+#endif
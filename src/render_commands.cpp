@@ -0,0 +1,111 @@
+#include <algorithm>
+
+#include "render_commands.hpp"
+
+void command_buffer::clear () {
+  commands_.clear();
+}
+
+void command_buffer::add (render_command::pass_type pass, render_command::program_type program,
+    render_command::texture_type texture, float x, float y, float w, float h) {
+  commands_.push_back({pass, program, texture, x, y, w, h});
+}
+
+void command_buffer::submit (render_backend& backend) {
+  // sorting the keys with their indices rather than the commands themselves keeps the sort stable without the
+  // scratch buffer std::stable_sort would allocate
+  keys_.resize(commands_.size());
+  for (std::size_t index = 0; index < commands_.size(); ++index) {
+    auto& command = commands_[index];
+    std::uint64_t key = (std::uint64_t)command.pass << 16 | (std::uint64_t)command.program << 8 | command.texture;
+    keys_[index] = key << 32 | index;
+  }
+  std::sort(keys_.begin(), keys_.end());
+  sorted_.resize(commands_.size());
+  for (std::size_t index = 0; index < keys_.size(); ++index) sorted_[index] = commands_[keys_[index] & 0xFFFFFFFF];
+  backend.submit(sorted_.data(), sorted_.size());
+}
+
+void block_changes::reset (int rows, int cols) {
+  cols_ = cols;
+  min_cols_.assign(rows, cols);
+  max_cols_.assign(rows, -1);
+  min_row_ = rows;
+  max_row_ = -1;
+}
+
+void block_changes::clear_block (int row, int col) {
+  min_cols_[row] = std::min(min_cols_[row], col);
+  max_cols_[row] = std::max(max_cols_[row], col);
+  min_row_ = std::min(min_row_, row);
+  max_row_ = std::max(max_row_, row);
+}
+
+// a run of consecutive changed rows goes up as a single rectangle as long as each row's changed columns overlap the
+// run's; a row whose span lies apart from them starts a run of its own, so that no clean blocks between the spans are
+// uploaded with them
+void block_changes::queue_uploads (command_buffer& out) {
+  for (auto row = min_row_; row <= max_row_; ) {
+    if (min_cols_[row] > max_cols_[row]) {
+      ++row;
+      continue;
+    }
+    auto first_row = row;
+    auto min_col = min_cols_[row], max_col = max_cols_[row];
+    for (; row <= max_row_ && min_cols_[row] <= max_col && max_cols_[row] >= min_col; ++row) {
+      min_col = std::min(min_col, min_cols_[row]);
+      max_col = std::max(max_col, max_cols_[row]);
+      min_cols_[row] = cols_;
+      max_cols_[row] = -1;
+    }
+    out.add(render_command::kBlockUploads, render_command::kBlocks, render_command::kBlockTexture,
+      min_col, first_row, max_col - min_col + 1, row - first_row);
+  }
+  min_row_ = (int)min_cols_.size();
+  max_row_ = -1;
+}
+
+void queue_frame (const sim_frame& frame, const frame_options& options, block_changes& blocks, command_buffer& out) {
+  auto wall_changed = options.wall_dirty || !blocks.is_empty();
+  blocks.queue_uploads(out);
+  if (wall_changed) {
+    out.add(render_command::kWall, render_command::kBlocks, render_command::kBlockTexture, 0.0f, 0.0f, 1.0f,
+      kFieldHeight);
+  }
+  if (wall_changed || options.backdrop_due) {
+    out.add(render_command::kScene, render_command::kBackdrop, render_command::kNoTexture, 0.0f, 0.0f, 1.0f,
+      1.0f / kAspect);
+    out.add(render_command::kScene, render_command::kBlit, render_command::kWallTexture, 0.0f, 0.0f, 1.0f,
+      1.0f / kAspect);
+  }
+
+  auto alpha = options.alpha;
+  out.add(render_command::kBackground, render_command::kBlit, render_command::kSceneTexture, 0.0f, 0.0f, 1.0f,
+    1.0f / kAspect);
+  out.add(render_command::kSprites, render_command::kPaddle, render_command::kNoTexture,
+    frame.get_computer_position(alpha), kPaddleY, kPaddleWidth, kPaddleHeight);
+  for (auto ball = 0; ball < frame.ball_count; ++ball) {
+    out.add(render_command::kSprites, render_command::kBall, render_command::kNoTexture,
+      frame.get_ball_x(ball, alpha), frame.get_ball_y(ball, alpha), kBallDiameter, kBallDiameter);
+  }
+  out.add(render_command::kSprites, render_command::kPaddle, render_command::kNoTexture,
+    options.player_position, -kPaddleY, kPaddleWidth, kPaddleHeight);
+  if (options.particles_live) {
+    out.add(render_command::kSprites, render_command::kParticles, render_command::kNoTexture, 0.0f, 0.0f, 1.0f,
+      1.0f / kAspect);
+  }
+}
+
+void recording_render_backend::submit (const render_command* commands, std::size_t count) {
+  last_frame_.assign(commands, commands + count);
+
+  // field by field, since the padding isn't guaranteed to be anything in particular
+  hash_.add(count);
+  for (auto command = commands; command != commands + count; ++command) {
+    hash_.add(command->pass);
+    hash_.add(command->program);
+    hash_.add(command->texture);
+    for (auto value : {command->x, command->y, command->w, command->h}) hash_.add(value);
+  }
+  ++frame_count_;
+}
@@ -0,0 +1,143 @@
+#include <cstring>
+
+#include "replay.hpp"
+#include "step_clock.hpp"
+
+namespace {
+
+const unsigned char kMagic[] {'B', 'T', 'R', 'P'};
+// covers what the steps mean as well as how they're laid out: a change to the simulation that plays the same input out
+// differently (ball-ball contacts, say) bumps it just as a change to the format does, so that old recordings are turned
+// away rather than diverging
+constexpr unsigned char kVersion = 2;
+
+std::uint64_t zigzag (std::int64_t value) {
+  return ((std::uint64_t)value << 1) ^ (std::uint64_t)(value >> 63);
+}
+
+std::int64_t unzigzag (std::uint64_t value) {
+  return (std::int64_t)(value >> 1) ^ -(std::int64_t)(value & 1);
+}
+
+void write_varint (std::vector<unsigned char>& out, std::uint64_t value) {
+  for (; value >= 0x80; value >>= 7) out.push_back((unsigned char)(value | 0x80));
+  out.push_back((unsigned char)value);
+}
+
+void write_fixed (std::vector<unsigned char>& out, std::uint64_t value, int bytes) {
+  for (auto i = 0; i < bytes; ++i) out.push_back((unsigned char)(value >> (i * 8)));
+}
+
+// reads from a buffer, failing (for good) at the first attempt to read past its end
+class byte_reader {
+public:
+  byte_reader (const unsigned char* data, std::size_t size) : it_(data), end_(data + size) {}
+
+  bool ok () const { return ok_; }
+  bool at_end () const { return it_ == end_; }
+
+  std::uint64_t read_varint () {
+    std::uint64_t value = 0;
+    for (auto shift = 0; shift < 64; shift += 7) {
+      if (it_ == end_) break;
+      auto byte = *it_++;
+      value |= (std::uint64_t)(byte & 0x7F) << shift;
+      if (!(byte & 0x80)) return value;
+    }
+    ok_ = false;
+    return 0;
+  }
+
+  std::uint64_t read_fixed (int bytes) {
+    if (end_ - it_ < bytes) {
+      ok_ = false;
+      return 0;
+    }
+    std::uint64_t value = 0;
+    for (auto i = 0; i < bytes; ++i) value |= (std::uint64_t)*it_++ << (i * 8);
+    return value;
+  }
+
+  bool skip_magic () {
+    if (end_ - it_ < (long)sizeof(kMagic) || std::memcmp(it_, kMagic, sizeof(kMagic)) != 0) ok_ = false;
+    else it_ += sizeof(kMagic);
+    return ok_;
+  }
+
+private:
+  const unsigned char* it_;
+  const unsigned char* end_;
+  bool ok_ = true;
+};
+
+std::uint32_t float_bits (float value) {
+  std::uint32_t bits;
+  std::memcpy(&bits, &value, sizeof(bits));
+  return bits;
+}
+
+float bits_float (std::uint32_t bits) {
+  float value;
+  std::memcpy(&value, &bits, sizeof(value));
+  return value;
+}
+
+}
+
+bool decode_replay (const unsigned char* data, std::size_t size, replay& out) {
+  byte_reader reader(data, size);
+  if (!reader.skip_magic() || reader.read_fixed(1) != kVersion) return false;
+  out.seed = (unsigned)reader.read_varint();
+  out.step_rate = bits_float((std::uint32_t)reader.read_fixed(4));
+  out.rows = (int)reader.read_varint();
+  out.cols = (int)reader.read_varint();
+  out.prediction_depth = (int)reader.read_varint();
+  auto step_count = reader.read_varint();
+  out.final_hash = reader.read_fixed(8);
+  // every step takes at least a byte, which bounds the count before we trust it with an allocation; the steps are
+  // played back at the recorded rate, so it had better be one
+  if (!reader.ok() || step_count > size || !is_valid_step_rate(out.step_rate)) return false;
+
+  out.steps.clear();
+  out.steps.reserve(step_count);
+  std::int64_t position = 0;
+  for (std::uint64_t step = 0; step < step_count; ++step) {
+    auto value = reader.read_varint();
+    position += unzigzag(value >> 1);
+    out.steps.push_back({dequantize_paddle_position((std::int32_t)position), (value & 1) != 0});
+  }
+  return reader.ok() && reader.at_end();
+}
+
+void replay_recorder::begin (unsigned seed, float step_rate, int rows, int cols, int prediction_depth) {
+  seed_ = seed;
+  step_rate_ = step_rate;
+  rows_ = rows;
+  cols_ = cols;
+  prediction_depth_ = prediction_depth;
+  step_count_ = 0;
+  last_position_ = 0;
+  steps_.clear();
+}
+
+float replay_recorder::record_step (float player_position, bool release) {
+  auto position = quantize_paddle_position(player_position);
+  write_varint(steps_, zigzag((std::int64_t)position - last_position_) << 1 | (release ? 1 : 0));
+  last_position_ = position;
+  ++step_count_;
+  return dequantize_paddle_position(position);
+}
+
+std::vector<unsigned char> replay_recorder::finish (std::uint64_t final_hash) const {
+  std::vector<unsigned char> out(kMagic, kMagic + sizeof(kMagic));
+  out.push_back(kVersion);
+  write_varint(out, seed_);
+  write_fixed(out, float_bits(step_rate_), 4);
+  write_varint(out, rows_);
+  write_varint(out, cols_);
+  write_varint(out, prediction_depth_);
+  write_varint(out, step_count_);
+  write_fixed(out, final_hash, 8);
+  out.insert(out.end(), steps_.begin(), steps_.end());
+  return out;
+}
@@ -0,0 +1,93 @@
+#include <algorithm>
+#include <limits>
+
+#include "resolution_controller.hpp"
+
+namespace {
+
+// frames this far over budget (on average) count as slow; vsync makes a missed frame take two intervals, so this
+// leaves plenty of room for jitter
+constexpr double kSlowFactor = 1.2;
+
+// how long frames must stay slow before we lower the scale, and how long they must stay within budget before we try
+// raising it
+constexpr double kLowerDelay = 0.25;
+constexpr double kRaiseDelay = 2.0;
+
+// a raise followed this soon by slow frames has failed, and we don't try that scale again for the retry delay
+constexpr double kRaiseProbation = 2.0;
+constexpr double kRetryDelay = 30.0;
+
+constexpr float kLowerFactor = 0.85f;
+constexpr float kRaiseStep = 0.05f;
+
+// longer frames than this are stalls (the tab being hidden, say) rather than anything resolution would help with
+constexpr double kMaxFrameTime = 0.25;
+
+constexpr double kAverageWeight = 0.1;
+
+}
+
+resolution_controller::resolution_controller (float min_scale, float max_scale, float target_rate) :
+    scale_(max_scale) {
+  set_bounds(min_scale, max_scale);
+  set_target_rate(target_rate);
+}
+
+void resolution_controller::set_bounds (float min_scale, float max_scale) {
+  min_scale_ = std::max(min_scale, 0.01f);
+  max_scale_ = std::max(max_scale, min_scale_);
+  scale_ = std::min(std::max(scale_, min_scale_), max_scale_);
+  failed_scale_ = 0.0f;
+}
+
+void resolution_controller::set_target_rate (float target_rate) {
+  // at zero the budget would be infinite, so the scale would only ever rise; below it (or infinite) every frame would
+  // count as slow, so it would only ever fall.  the comparisons are false for NaN, too
+  if (!(target_rate > 0.0f && target_rate <= std::numeric_limits<float>::max())) return;
+  target_rate_ = target_rate;
+  average_frame_time_ = 1.0 / target_rate;
+  failed_scale_ = 0.0f;
+}
+
+bool resolution_controller::update (double frame_time) {
+  if (frame_time <= 0.0 || frame_time > kMaxFrameTime) return false;
+
+  auto budget = 1.0 / target_rate_;
+  average_frame_time_ += (frame_time - average_frame_time_) * kAverageWeight;
+  if (since_raise_ >= 0.0 && (since_raise_ += frame_time) > kRaiseProbation) since_raise_ = -1.0;
+  if (failed_scale_ > 0.0f && (since_failure_ += frame_time) > kRetryDelay) failed_scale_ = 0.0f;
+
+  if (average_frame_time_ > budget * kSlowFactor) {
+    steady_time_ = 0.0;
+    if ((slow_time_ += frame_time) < kLowerDelay) return false;
+    if (since_raise_ >= 0.0) {
+      // undo the raise and remember not to try it again soon
+      failed_scale_ = scale_;
+      since_failure_ = 0.0;
+      since_raise_ = -1.0;
+      set_scale(scale_before_raise_);
+      return true;
+    }
+    if (scale_ == min_scale_) return false;
+    set_scale(scale_ * kLowerFactor);
+    return true;
+  }
+  slow_time_ = 0.0;
+  if ((steady_time_ += frame_time) < kRaiseDelay) return false;
+  auto raised = std::min(scale_ + kRaiseStep, max_scale_);
+  if (raised == scale_ || (failed_scale_ > 0.0f && raised >= failed_scale_)) return false;
+  scale_before_raise_ = scale_;
+  since_raise_ = 0.0;
+  set_scale(raised);
+  return true;
+}
+
+void resolution_controller::set_scale (float scale) {
+  scale_ = std::min(std::max(scale, min_scale_), max_scale_);
+
+  // start afresh at the new scale
+  average_frame_time_ = 1.0 / target_rate_;
+  slow_time_ = 0.0;
+  steady_time_ = 0.0;
+}
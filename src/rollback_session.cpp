@@ -0,0 +1,245 @@
+#include <chrono>
+#include <cmath>
+
+#include "replay.hpp"
+#include "rollback_session.hpp"
+#include "step_clock.hpp"
+
+namespace {
+
+// enough frames of input for any delay, prediction window and round trip we'd play with
+constexpr int kInputHistory = 1024;
+
+// unacknowledged input is resent in every packet (oldest first), so a lost packet costs nothing but latency
+constexpr int kMaxInputsPerPacket = 64;
+
+// each packet: the first frame it carries input for, the sender's acknowledgement (it has our input for every frame
+// before this), the input count, then the inputs (position, release and when it was made); all little-endian
+constexpr std::size_t kHeaderSize = 4 + 4 + 2;
+constexpr std::size_t kInputSize = 4 + 1 + 4;
+
+void write_u32 (unsigned char* out, std::uint32_t value) {
+  for (auto i = 0; i < 4; ++i) out[i] = (unsigned char)(value >> (i * 8));
+}
+
+std::uint32_t read_u32 (const unsigned char* in) {
+  return in[0] | in[1] << 8 | in[2] << 16 | (std::uint32_t)in[3] << 24;
+}
+
+rollback_config sanitize (rollback_config config) {
+  config.input_delay = std::min(std::max(config.input_delay, 0), kInputHistory / 4);
+  config.max_prediction = std::min(std::max(config.max_prediction, 1), kInputHistory / 4);
+  return config;
+}
+
+bool operator!= (const paddle_input& a, const paddle_input& b) {
+  return a.position != b.position || a.release != b.release;
+}
+
+void apply_input (game& target, int side, const paddle_input& input) {
+  auto position = dequantize_paddle_position(input.position);
+  if (side == kPlayerBallIndex) {
+    target.set_player_position(position);
+    if (input.release) target.maybe_release_player_ball();
+
+  } else {
+    target.set_opponent_position(position);
+    if (input.release) target.maybe_release_opponent_ball();
+  }
+}
+
+}
+
+rollback_session::rollback_session (game_listener& listener, transport& link, int local_side, unsigned seed,
+    float step_rate, const rollback_config& config) :
+    link_(link),
+    local_side_(local_side),
+    step_duration_(step_clock(step_rate).get_step_duration()),
+    config_(sanitize(config)),
+    events_(listener),
+    game_(events_, seed),
+    snapshots_(config_.max_prediction + 1, game_),
+    local_inputs_(kInputHistory),
+    remote_inputs_(kInputHistory),
+    remote_input_frames_(kInputHistory, -1),
+    local_input_stamps_(kInputHistory),
+    remote_input_stamps_(kInputHistory),
+    used_remote_inputs_(kInputHistory) {
+  game_.set_opponent_human(true);
+  game_.reset();
+
+  // nobody has input for the first frames, during the delay, so both sides hold still
+  for (long frame = 0; frame < config_.input_delay; ++frame) {
+    local_inputs_[get_slot(frame)] = remote_inputs_[get_slot(frame)] = {0, false};
+    remote_input_frames_[get_slot(frame)] = frame;
+  }
+  local_frames_ = remote_frames_ = config_.input_delay;
+}
+
+bool rollback_session::advance (float local_position, bool local_release) {
+  receive_input();
+  if (is_desynced()) return false;
+  if (frame_ - remote_frames_ >= config_.max_prediction) {
+    ++metrics_.stalls;
+    send_input();
+    return false;
+  }
+
+  local_inputs_[get_slot(local_frames_)] = {quantize_paddle_position(local_position), local_release};
+  local_input_stamps_[get_slot(local_frames_)] = get_stamp();
+  ++local_frames_;
+  send_input();
+
+  // the first frames run on the made-up input of the delay, which nobody waited for
+  auto frame = frame_++;
+  run_frame(frame);
+  ++metrics_.frames;
+  if (frame >= config_.input_delay) {
+    ++metrics_.local_inputs;
+    metrics_.local_input_latency_seconds += get_seconds_since(local_input_stamps_[get_slot(frame)]);
+    if (frame < remote_frames_) {
+      ++metrics_.remote_inputs;
+      metrics_.remote_input_latency_seconds += get_seconds_since(remote_input_stamps_[get_slot(frame)]);
+    }
+  }
+  events_.confirm(get_confirmed_frame());
+  return true;
+}
+
+void rollback_session::poll () {
+  receive_input();
+  send_input();
+}
+
+void rollback_session::receive_input () {
+  if (is_desynced()) return;
+  auto first_wrong_frame = frame_;
+  while (link_.receive(packet_)) {
+    if (packet_.size() < kHeaderSize) continue;
+    auto first = (long)read_u32(&packet_[0]);
+    acknowledged_frames_ = std::max(acknowledged_frames_, (long)read_u32(&packet_[4]));
+    auto count = (long)(packet_[8] | packet_[9] << 8);
+    if (packet_.size() != kHeaderSize + count * kInputSize) continue;
+
+    for (long index = 0; index < count; ++index) {
+      auto frame = first + index;
+      // anything further ahead than half the history would overwrite input we may still need to roll back with
+      if (frame < remote_frames_ || frame >= remote_frames_ + kInputHistory / 2) continue;
+      auto data = &packet_[kHeaderSize + index * kInputSize];
+      remote_inputs_[get_slot(frame)] = {(std::int32_t)read_u32(data), data[4] != 0};
+      remote_input_stamps_[get_slot(frame)] = read_u32(data + 5);
+      remote_input_frames_[get_slot(frame)] = frame;
+    }
+
+    // take in the newly contiguous input, checking it against what was predicted; input for frames already run is
+    // on screen once this returns (rolled back to if the guess was wrong), and the rest once its frame runs
+    for (; remote_input_frames_[get_slot(remote_frames_)] == remote_frames_; ++remote_frames_) {
+      if (remote_frames_ >= frame_) continue;
+      auto slot = get_slot(remote_frames_);
+      if (remote_inputs_[slot] != used_remote_inputs_[slot]) {
+        first_wrong_frame = std::min(first_wrong_frame, remote_frames_);
+      }
+      ++metrics_.remote_inputs;
+      metrics_.remote_input_latency_seconds += get_seconds_since(remote_input_stamps_[slot]);
+    }
+  }
+  if (first_wrong_frame < frame_) roll_back(first_wrong_frame);
+}
+
+void rollback_session::send_input () {
+  auto first = std::max(acknowledged_frames_, local_frames_ - kInputHistory);
+  auto count = std::min(local_frames_ - first, (long)kMaxInputsPerPacket);
+  packet_.resize(kHeaderSize + count * kInputSize);
+  write_u32(&packet_[0], (std::uint32_t)first);
+  write_u32(&packet_[4], (std::uint32_t)remote_frames_);
+  packet_[8] = (unsigned char)count;
+  packet_[9] = (unsigned char)(count >> 8);
+  for (long index = 0; index < count; ++index) {
+    auto& input = local_inputs_[get_slot(first + index)];
+    auto data = &packet_[kHeaderSize + index * kInputSize];
+    write_u32(data, (std::uint32_t)input.position);
+    data[4] = input.release ? 1 : 0;
+    write_u32(data + 5, local_input_stamps_[get_slot(first + index)]);
+  }
+  link_.send(packet_.data(), packet_.size());
+}
+
+void rollback_session::run_frame (long frame) {
+  snapshots_.save(game_, frame);
+  auto slot = get_slot(frame);
+  // until the peer's input arrives, guess that its paddle stays where it last was
+  auto& remote = used_remote_inputs_[slot];
+  if (frame < remote_frames_) remote = remote_inputs_[slot];
+  else if (remote_frames_ > 0) remote = {remote_inputs_[get_slot(remote_frames_ - 1)].position, false};
+  else remote = {0, false};
+
+  // the same order on both peers, whichever side is local
+  auto& local = local_inputs_[slot];
+  auto& bottom = (local_side_ == kPlayerBallIndex) ? local : remote;
+  auto& top = (local_side_ == kPlayerBallIndex) ? remote : local;
+  apply_input(game_, kPlayerBallIndex, bottom);
+  apply_input(game_, kComputerBallIndex, top);
+  events_.set_frame(frame);
+  game_.tick(step_duration_);
+}
+
+void rollback_session::roll_back (long frame) {
+  // stalling at max_prediction keeps every frame that can be wrong in the ring, so this is a bug rather than bad luck
+  // on the link; carrying on from the wrong state would only hide it
+  if (!snapshots_.load(game_, frame)) {
+    desync_frame_ = frame;
+    return;
+  }
+  auto start = std::chrono::steady_clock::now();
+  events_.begin_rerun(frame);
+  for (auto rerun = frame; rerun < frame_; ++rerun) run_frame(rerun);
+  events_.end_rerun();
+  std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+  ++metrics_.rollbacks;
+  metrics_.resimulated_frames += frame_ - frame;
+  metrics_.longest_rollback = std::max(metrics_.longest_rollback, (int)(frame_ - frame));
+  metrics_.resimulation_seconds += elapsed.count();
+}
+
+std::uint32_t rollback_session::get_stamp () const {
+  return (std::uint32_t)std::llround(link_.get_time() * 1e6);
+}
+
+double rollback_session::get_seconds_since (std::uint32_t stamp) const {
+  return (std::uint32_t)(get_stamp() - stamp) * 1e-6;
+}
+
+void rollback_session::event_filter::begin_rerun (long frame) {
+  rerunning_ = true;
+  auto first_undone = std::find_if(clears_.begin(), clears_.end(),
+    [=](const block_clear& clear) { return clear.frame >= frame; });
+  undone_clears_.assign(first_undone, clears_.end());
+  clears_.erase(first_undone, clears_.end());
+  rerun_clears_.clear();
+}
+
+void rollback_session::event_filter::end_rerun () {
+  rerunning_ = false;
+  auto find_block = [](const std::vector<block_clear>& clears, const block_clear& block) {
+    return std::find_if(clears.begin(), clears.end(),
+      [&](const block_clear& clear) { return clear.row == block.row && clear.col == block.col; }) != clears.end();
+  };
+  for (auto& clear : undone_clears_) {
+    if (!find_block(rerun_clears_, clear)) target_.restore_block(clear.row, clear.col);
+  }
+  for (auto& clear : rerun_clears_) {
+    if (!find_block(undone_clears_, clear)) target_.clear_block(clear.row, clear.col);
+  }
+  clears_.insert(clears_.end(), rerun_clears_.begin(), rerun_clears_.end());
+}
+
+void rollback_session::event_filter::confirm (long frame) {
+  clears_.erase(clears_.begin(), std::find_if(clears_.begin(), clears_.end(),
+    [=](const block_clear& clear) { return clear.frame >= frame; }));
+}
+
+void rollback_session::event_filter::clear_block (int row, int col) {
+  (rerunning_ ? rerun_clears_ : clears_).push_back({frame_, row, col});
+  if (!rerunning_) target_.clear_block(row, col);
+}
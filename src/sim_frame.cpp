@@ -0,0 +1,17 @@
+#include "sim_frame.hpp"
+
+void sim_frame::capture (const game& source, long step, double time) {
+  this->step = step;
+  this->time = time;
+  previous_computer_position = source.get_computer_position(0.0f);
+  computer_position = source.get_computer_position();
+  player_position = source.get_player_position();
+  ball_count = source.get_ball_count();
+  for (auto array : {&previous_x, &previous_y, &x, &y}) array->resize(ball_count);
+  for (auto ball = 0; ball < ball_count; ++ball) {
+    previous_x[ball] = source.get_ball_x(ball, 0.0f);
+    previous_y[ball] = source.get_ball_y(ball, 0.0f);
+    x[ball] = source.get_ball_x(ball);
+    y[ball] = source.get_ball_y(ball);
+  }
+}
@@ -0,0 +1,96 @@
+#include <chrono>
+
+#include "profiler.hpp"
+#include "sim_worker.hpp"
+
+namespace {
+
+// input arrives once per rendered frame and is drained every step, so this only fills if the worker stops altogether
+constexpr std::size_t kInputCapacity = 256;
+
+// enough for a field's worth of block clears before the worker has to wait for the main thread
+constexpr std::size_t kEventCapacity = 4096;
+
+}
+
+sim_worker::sim_worker (unsigned seed, float step_rate, int rows, int cols) :
+    listener_(*this),
+    game_(listener_, seed),
+    clock_(step_rate),
+    inputs_(kInputCapacity),
+    events_(kEventCapacity) {
+  game_.set_field_size(rows, cols);
+  game_.reset();
+  recorder_.begin(seed, step_rate, get_rows(), get_cols(), kDefaultPredictionDepth);
+  publish_frame();
+}
+
+sim_worker::~sim_worker () {
+  stop();
+  delete replay_.exchange(nullptr);
+}
+
+void sim_worker::start () {
+  if (running_.exchange(true)) return;
+  thread_ = std::thread([this] { run(); });
+}
+
+void sim_worker::stop () {
+  running_.store(false, std::memory_order_release);
+  if (thread_.joinable()) thread_.join();
+}
+
+void sim_worker::send_input (float player_position, bool release) {
+  inputs_.push({player_position, release});
+}
+
+double sim_worker::now () {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void sim_worker::run () {
+  auto last = now();
+  while (running_.load(std::memory_order_acquire)) {
+    auto current = now();
+    auto steps = clock_.advance(current - last);
+    last = current;
+    if (steps > 0) {
+      // the position is the latest sent, and a launch requested at any point since the last step counts
+      input latest;
+      while (inputs_.pop(latest)) {
+        current_input_.player_position = latest.player_position;
+        current_input_.release = current_input_.release || latest.release;
+      }
+      for (; steps > 0; --steps) {
+        game_.set_player_position(recorder_.record_step(current_input_.player_position, current_input_.release));
+        if (current_input_.release) game_.maybe_release_player_ball();
+        current_input_.release = false;
+        game_.tick(clock_.get_step_duration());
+        ++step_;
+        PROFILE_END_FRAME();
+      }
+      publish_frame();
+    }
+
+    if (replay_requested_.exchange(false, std::memory_order_acq_rel)) {
+      auto data = new std::vector<unsigned char>(recorder_.finish(game_.get_state_hash()));
+      delete replay_.exchange(data, std::memory_order_acq_rel);
+    }
+
+    // sleep until the next step is due
+    auto wait = clock_.get_step_duration() * (1.0f - clock_.get_alpha());
+    std::this_thread::sleep_for(std::chrono::duration<double>(wait));
+  }
+}
+
+void sim_worker::push_event (const sim_event& event) {
+  while (!events_.push(event)) {
+    if (!running_.load(std::memory_order_acquire)) return;
+    std::this_thread::yield();
+  }
+}
+
+void sim_worker::publish_frame () {
+  frames_.get_back().capture(game_, step_, now());
+  frames_.publish();
+}
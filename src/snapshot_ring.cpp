@@ -0,0 +1,31 @@
+#include <algorithm>
+
+#include "snapshot_ring.hpp"
+
+snapshot_ring::snapshot_ring (int capacity, const game& prototype) :
+    snapshots_(std::max(capacity, 1)),
+    steps_(snapshots_.size()) {
+  // saving the prototype into every slot allocates their storage now rather than during play
+  for (auto& snapshot : snapshots_) prototype.save_state(snapshot);
+  clear();
+}
+
+void snapshot_ring::clear () {
+  std::fill(steps_.begin(), steps_.end(), -1L);
+}
+
+void snapshot_ring::save (const game& source, long step) {
+  auto slot = get_slot(step);
+  source.save_state(snapshots_[slot]);
+  steps_[slot] = step;
+}
+
+bool snapshot_ring::load (game& target, long step) const {
+  if (!contains(step)) return false;
+  target.load_state(snapshots_[get_slot(step)]);
+  return true;
+}
+
+bool snapshot_ring::contains (long step) const {
+  return step >= 0 && steps_[get_slot(step)] == step;
+}
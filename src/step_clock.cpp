@@ -0,0 +1,26 @@
+#include <algorithm>
+
+#include "step_clock.hpp"
+
+step_clock::step_clock (float step_rate, int max_steps) : max_steps_(max_steps) {
+  set_step_rate(step_rate);
+}
+
+void step_clock::set_step_rate (float step_rate) {
+  if (!is_valid_step_rate(step_rate)) return;
+  step_rate_ = step_rate;
+  step_duration_ = 1.0f / step_rate;
+  accumulator_ = std::min(accumulator_, (double)step_duration_);
+}
+
+int step_clock::advance (double dt) {
+  accumulator_ += std::max(dt, 0.0);
+  auto steps = (int)(accumulator_ / step_duration_);
+  if (steps > max_steps_) {
+    steps = max_steps_;
+    accumulator_ = 0.0;
+  } else {
+    accumulator_ -= steps * (double)step_duration_;
+  }
+  return steps;
+}
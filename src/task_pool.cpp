@@ -0,0 +1,130 @@
+#include <algorithm>
+
+#include "task_pool.hpp"
+
+namespace {
+
+// the pool and worker index of the current thread, if it's a worker
+thread_local const task_pool* current_pool = nullptr;
+thread_local int current_index = -1;
+
+}
+
+task_pool::task_pool (int thread_count) {
+  if (thread_count <= 0) thread_count = std::max(1u, std::thread::hardware_concurrency());
+  for (auto i = 0; i < thread_count; ++i) queues_.emplace_back(new worker_queue());
+  for (auto i = 0; i < thread_count; ++i) threads_.emplace_back(&task_pool::run_worker, this, i);
+}
+
+task_pool::~task_pool () {
+  {
+    std::lock_guard<std::mutex> lock(wake_mutex_);
+    stopping_ = true;
+  }
+  wake_.notify_all();
+  for (auto& thread : threads_) thread.join();
+}
+
+void task_pool::submit (std::function<void()> task) {
+  auto index = (current_pool == this) ? current_index : (int)(next_queue_++ % queues_.size());
+  ++pending_;
+  {
+    std::lock_guard<std::mutex> lock(queues_[index]->mutex);
+    queues_[index]->tasks.push_back(std::move(task));
+  }
+  {
+    // incremented under the wake mutex so that a worker can't check for work, miss this and then sleep through it
+    std::lock_guard<std::mutex> lock(wake_mutex_);
+    ++queued_;
+  }
+  wake_.notify_one();
+}
+
+void task_pool::wait () {
+  while (pending_ > 0) {
+    if (run_one(current_pool == this ? current_index : -1)) continue;
+    std::unique_lock<std::mutex> lock(wake_mutex_);
+    done_.wait(lock, [this] { return pending_ == 0 || queued_ > 0; });
+  }
+}
+
+void task_pool::run_indexed (int count, const std::function<void(int)>& fn) {
+  if (count <= 0) return;
+  {
+    std::lock_guard<std::mutex> lock(indexed_mutex_);
+    indexed_fn_ = &fn;
+    indexed_count_ = count;
+    next_index_ = 0;
+  }
+  pending_ += count;
+  {
+    std::lock_guard<std::mutex> lock(wake_mutex_);
+    queued_ += count;
+  }
+  wake_.notify_all();
+  wait();
+
+  std::lock_guard<std::mutex> lock(indexed_mutex_);
+  indexed_fn_ = nullptr;
+}
+
+void task_pool::run_worker (int index) {
+  current_pool = this;
+  current_index = index;
+  while (true) {
+    if (run_one(index)) continue;
+    std::unique_lock<std::mutex> lock(wake_mutex_);
+    wake_.wait(lock, [this] { return stopping_ || queued_ > 0; });
+    if (stopping_) return;
+  }
+}
+
+bool task_pool::run_one (int index) {
+  const std::function<void(int)>* indexed_fn = nullptr;
+  auto indexed_index = 0;
+  {
+    std::lock_guard<std::mutex> lock(indexed_mutex_);
+    if (indexed_fn_ && next_index_ < indexed_count_) {
+      indexed_fn = indexed_fn_;
+      indexed_index = next_index_++;
+    }
+  }
+  if (indexed_fn) {
+    --queued_;
+    (*indexed_fn)(indexed_index);
+    finish_one();
+    return true;
+  }
+
+  std::function<void()> task;
+  if (index >= 0) {
+    auto& own = *queues_[index];
+    std::lock_guard<std::mutex> lock(own.mutex);
+    if (!own.tasks.empty()) {
+      task = std::move(own.tasks.back());
+      own.tasks.pop_back();
+    }
+  }
+  auto count = (int)queues_.size();
+  for (auto offset = 1; !task && offset <= count; ++offset) {
+    auto& victim = *queues_[(index + offset + count) % count];
+    std::lock_guard<std::mutex> lock(victim.mutex);
+    if (!victim.tasks.empty()) {
+      task = std::move(victim.tasks.front());
+      victim.tasks.pop_front();
+    }
+  }
+  if (!task) return false;
+  --queued_;
+
+  task();
+  finish_one();
+  return true;
+}
+
+void task_pool::finish_one () {
+  if (--pending_ == 0) {
+    std::lock_guard<std::mutex> lock(wake_mutex_);
+    done_.notify_all();
+  }
+}
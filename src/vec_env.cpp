@@ -0,0 +1,159 @@
+#include <algorithm>
+
+#include "vec_env.hpp"
+
+namespace {
+
+// spreads the seeds of an environment's successive episodes apart
+constexpr unsigned kEpisodeSeedStride = 0x9E3779B9u;
+
+}
+
+void vec_env::environment_listener::clear_block (int row, int col) {
+  auto cells = (int)env_.cell_sizes_.size();
+  --env_.cell_counts_[index_ * cells + env_.block_cells_[row * env_.games_[index_]->get_field_cols() + col]];
+}
+
+void vec_env::environment_listener::play_loss (int ball) {
+  // the ball hasn't been reattached to its paddle yet, so its position tells us which end it left through: the
+  // agent's is the top
+  if (env_.games_[index_]->get_ball_y(ball) > 0.0f) {
+    ++env_.opponent_scores_[index_];
+    env_.step_rewards_[index_] -= 1.0f;
+  } else {
+    ++env_.agent_scores_[index_];
+    env_.step_rewards_[index_] += 1.0f;
+  }
+}
+
+vec_env::vec_env (int count, const vec_env_config& config, int thread_count) :
+    config_(config),
+    step_duration_(step_clock(config.step_rate).get_step_duration()),
+    pool_(thread_count) {
+  count = std::max(count, 1);
+  config_.max_balls = std::max(config_.max_balls, 0);
+  config_.batch_size = std::max(config_.batch_size, 1);
+  if (config_.max_steps <= 0) config_.max_steps = (long)(config_.step_rate * 60.0f * 10.0f);
+
+  // the listeners are referred to by the games, so they mustn't move
+  listeners_.reserve(count);
+  for (auto index = 0; index < count; ++index) {
+    listeners_.emplace_back(*this, index);
+    games_.emplace_back(new game(listeners_.back()));
+    auto& match = *games_.back();
+    match.set_field_size(config_.rows, config_.cols);
+    match.set_opponent_human(true);
+    match.set_player_autopilot(true);
+    match.set_prediction_depth(kPlayerBallIndex, config_.opponent_depth);
+  }
+
+  // the view can't be finer than the field
+  auto rows = games_[0]->get_field_rows(), cols = games_[0]->get_field_cols();
+  config_.view_rows = std::min(std::max(config_.view_rows, 1), rows);
+  config_.view_cols = std::min(std::max(config_.view_cols, 1), cols);
+  cell_sizes_.assign(config_.view_rows * config_.view_cols, 0);
+  block_cells_.resize(rows * cols);
+  for (auto row = 0; row < rows; ++row) {
+    for (auto col = 0; col < cols; ++col) {
+      auto cell = (row * config_.view_rows / rows) * config_.view_cols + col * config_.view_cols / cols;
+      block_cells_[row * cols + col] = cell;
+      ++cell_sizes_[cell];
+    }
+  }
+  cell_counts_.resize(count * cell_sizes_.size());
+
+  observation_size_ = 2 + config_.max_balls * 5 + (int)cell_sizes_.size();
+  seeds_.resize(count);
+  episodes_.resize(count);
+  episode_steps_.resize(count);
+  agent_scores_.resize(count);
+  opponent_scores_.resize(count);
+  step_rewards_.resize(count);
+
+  run_batch_ = [this](int batch) {
+    for (auto index = batch * config_.batch_size, last = std::min(index + config_.batch_size, get_count());
+        index < last; ++index) {
+      (this->*batch_fn_)(index);
+    }
+  };
+}
+
+void vec_env::reset (const unsigned* seeds, float* observations) {
+  reset_seeds_ = seeds;
+  observations_ = observations;
+  run_batches(&vec_env::reset_environment);
+}
+
+void vec_env::step (const float* actions, float* observations, float* rewards, float* dones) {
+  actions_ = actions;
+  observations_ = observations;
+  rewards_ = rewards;
+  dones_ = dones;
+  run_batches(&vec_env::step_environment);
+}
+
+long vec_env::get_episodes_finished () const {
+  long total = 0;
+  for (auto episodes : episodes_) total += episodes;
+  return total;
+}
+
+void vec_env::run_batches (void (vec_env::*fn) (int index)) {
+  batch_fn_ = fn;
+  pool_.run_indexed((get_count() + config_.batch_size - 1) / config_.batch_size, run_batch_);
+}
+
+void vec_env::reset_environment (int index) {
+  seeds_[index] = reset_seeds_[index];
+  episodes_[index] = 0;
+  start_episode(index);
+  write_observation(index);
+}
+
+void vec_env::step_environment (int index) {
+  auto& match = *games_[index];
+  auto action = actions_ + index * kActionSize;
+  step_rewards_[index] = 0.0f;
+  match.set_opponent_position(action[0]);
+  if (action[1] > 0.5f) match.maybe_release_opponent_ball();
+  match.tick(step_duration_);
+
+  auto done = ++episode_steps_[index] >= config_.max_steps || agent_scores_[index] >= config_.points ||
+    opponent_scores_[index] >= config_.points;
+  rewards_[index] = step_rewards_[index];
+  dones_[index] = done ? 1.0f : 0.0f;
+  if (done) {
+    ++episodes_[index];
+    start_episode(index);
+  }
+  write_observation(index);
+}
+
+void vec_env::start_episode (int index) {
+  auto& match = *games_[index];
+  match.seed(seeds_[index] + (unsigned)episodes_[index] * kEpisodeSeedStride);
+  match.reset();
+  episode_steps_[index] = 0;
+  agent_scores_[index] = opponent_scores_[index] = 0;
+  std::copy(cell_sizes_.begin(), cell_sizes_.end(), cell_counts_.begin() + index * cell_sizes_.size());
+}
+
+void vec_env::write_observation (int index) const {
+  auto& match = *games_[index];
+  auto out = observations_ + index * observation_size_;
+  *out++ = match.get_computer_position();
+  *out++ = match.get_player_position();
+
+  auto balls = std::min(match.get_ball_count(), config_.max_balls);
+  for (auto ball = 0; ball < balls; ++ball) {
+    *out++ = match.get_ball_x(ball);
+    *out++ = match.get_ball_y(ball);
+    *out++ = match.get_ball_vx(ball);
+    *out++ = match.get_ball_vy(ball);
+    *out++ = 1.0f;
+  }
+  out = std::fill_n(out, (config_.max_balls - balls) * 5, 0.0f);
+
+  auto counts = cell_counts_.begin() + index * cell_sizes_.size();
+  for (auto cell = 0; cell < (int)cell_sizes_.size(); ++cell) *out++ = (float)counts[cell] / cell_sizes_[cell];
+}
@@ -0,0 +1,73 @@
+#include <algorithm>
+#include <cmath>
+
+#include "voice_mixer.hpp"
+
+namespace {
+
+// sounds merged from several requests play louder, but not without limit: uncorrelated sounds add in power, so n
+// at once are about sqrt(n) times as loud as one
+constexpr float kMaxMergedGainScale = 2.0f;
+
+}
+
+voice_mixer::voice_mixer (int voice_count) : voices_(std::max(voice_count, 1)) {}
+
+int voice_mixer::add_sound (double duration, int priority, float gain) {
+  sounds_.push_back({duration, priority, gain});
+  request_counts_.push_back(0);
+  return (int)sounds_.size() - 1;
+}
+
+void voice_mixer::request (int sound) {
+  ++metrics_.requests;
+  if (request_counts_[sound]++ == 0) requested_sounds_.push_back(sound);
+}
+
+const std::vector<voice_mixer::voice_start>& voice_mixer::mix (double time) {
+  starts_.clear();
+
+  // the most important sounds get first pick of the voices
+  std::stable_sort(requested_sounds_.begin(), requested_sounds_.end(), [&](int a, int b) {
+    return sounds_[a].priority > sounds_[b].priority;
+  });
+  for (auto id : requested_sounds_) {
+    auto& sound = sounds_[id];
+    auto count = request_counts_[id];
+    request_counts_[id] = 0;
+
+    auto index = find_voice(sound.priority, time);
+    if (index < 0) {
+      ++metrics_.drops;
+      continue;
+    }
+    auto& voice = voices_[index];
+    auto stolen = (voice.end_time > time);
+    if (stolen) ++metrics_.steals;
+    ++metrics_.starts;
+    voice.priority = sound.priority;
+    voice.start_time = time;
+    voice.end_time = time + sound.duration;
+    auto gain = sound.gain * std::min(std::sqrt((float)count), kMaxMergedGainScale);
+    starts_.push_back({index, id, gain, stolen});
+  }
+  requested_sounds_.clear();
+  return starts_;
+}
+
+int voice_mixer::find_voice (int priority, double time) const {
+  auto best = -1;
+  for (auto index = 0; index < (int)voices_.size(); ++index) {
+    auto& voice = voices_[index];
+    if (voice.end_time <= time) return index;
+
+    // never steal from a sound that started this frame, or from a more important one
+    if (voice.start_time >= time || voice.priority > priority) continue;
+    auto& current = voices_[best < 0 ? index : best];
+    if (best < 0 || voice.priority < current.priority ||
+        (voice.priority == current.priority && voice.start_time < current.start_time)) {
+      best = index;
+    }
+  }
+  return best;
+}
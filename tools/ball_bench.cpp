@@ -0,0 +1,114 @@
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include "ball_grid.hpp"
+#include "ball_pool.hpp"
+#include "logic.hpp"
+#include "step_clock.hpp"
+
+namespace {
+
+constexpr float kSpawnSpeed = 0.5f;
+
+// balls per unit area in the constant-density grid runs: about one per grid cell
+constexpr float kGridDensity = 1.0f / (kBallDiameter * kBallDiameter);
+
+void print_usage () {
+  std::cerr << "Usage: ball_bench [--balls N]... [--rows N] [--cols N] [--steps N] [--seed N]" << std::endl;
+}
+
+}
+
+int main (int argc, char** argv) {
+  std::vector<int> ball_counts;
+  int steps = 2000;
+  unsigned seed = 1;
+  int rows = kDefaultFieldRows;
+  int cols = kDefaultFieldCols;
+  for (auto i = 1; i < argc; ++i) {
+    if (i + 1 < argc && std::strcmp(argv[i], "--balls") == 0) ball_counts.push_back(std::atoi(argv[++i]));
+    else if (i + 1 < argc && std::strcmp(argv[i], "--steps") == 0) steps = std::atoi(argv[++i]);
+    else if (i + 1 < argc && std::strcmp(argv[i], "--seed") == 0) seed = std::strtoul(argv[++i], nullptr, 10);
+    else if (i + 1 < argc && std::strcmp(argv[i], "--rows") == 0) rows = std::atoi(argv[++i]);
+    else if (i + 1 < argc && std::strcmp(argv[i], "--cols") == 0) cols = std::atoi(argv[++i]);
+    else {
+      print_usage();
+      return EXIT_FAILURE;
+    }
+  }
+  if (ball_counts.empty()) ball_counts = {2, 16, 256, 1024, 4096, 10000};
+
+  set_player_autopilot(true);
+  set_field_size(rows, cols);
+  auto step_duration = 1.0f / kDefaultStepRate;
+
+  for (auto count : ball_counts) {
+    std::default_random_engine engine(seed);
+    std::uniform_real_distribution<float> x_distribution(-0.45f, 0.45f);
+    // spawn in the gaps between the blocks and the paddles, on either side
+    std::uniform_real_distribution<float> y_distribution(kFieldHeight * 0.5f + kBallDiameter, kPaddleY - kBallDiameter);
+    std::uniform_real_distribution<float> angle_distribution(0.0f, M_PI * 2.0f);
+    auto top_up = [&]() {
+      while (get_ball_count() < kOwnedBallCount + count) {
+        auto angle = angle_distribution(engine);
+        auto side = (get_ball_count() % 2 == 0) ? 1.0f : -1.0f;
+        spawn_ball(
+          x_distribution(engine), y_distribution(engine) * side,
+          std::cos(angle) * kSpawnSpeed, std::sin(angle) * kSpawnSpeed,
+          get_ball_count() % kOwnedBallCount);
+      }
+    };
+    reset_game();
+    top_up();
+
+    // lost balls are replaced between steps so that the count stays (roughly) constant
+    long ball_steps = 0;
+    long pairs_tested = 0;
+    long contacts = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (auto step = 0; step < steps; ++step) {
+      ball_steps += get_ball_count();
+      tick(step_duration);
+      pairs_tested += get_shared_game().get_ball_pairs_tested();
+      contacts += get_shared_game().get_ball_contacts();
+      top_up();
+    }
+    std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+
+    std::cout << "balls: " << count << ", steps: " << steps << ", ns per ball-step: " <<
+      elapsed.count() / ball_steps << ", pairs tested per step: " << (double)pairs_tested / steps <<
+      ", contacts per step: " << (double)contacts / steps << std::endl;
+  }
+
+  // the game's field is a fixed size, so the counts above crowd it ever more; these runs time the grid alone on a
+  // field that grows with the count, so that the balls per cell (and so the pairs per ball) stay the same
+  for (auto count : ball_counts) {
+    auto half_size = std::sqrt(count / kGridDensity) * 0.5f;
+    std::default_random_engine engine(seed);
+    std::uniform_real_distribution<float> distribution(-half_size, half_size);
+    ball_pool balls;
+    for (auto ball = 0; ball < count; ++ball) balls.add(distribution(engine), distribution(engine), 0.0f, 0.0f, 0);
+
+    ball_grid grid(kBallDiameter, half_size, half_size);
+    std::vector<ball_pair> pairs;
+    long pairs_tested = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (auto step = 0; step < steps; ++step) {
+      grid.build(balls);
+      pairs_tested += grid.find_pairs(kBallDiameter, pairs);
+    }
+    std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+
+    std::cout << "grid balls: " << count << ", steps: " << steps << ", ns per ball-step: " <<
+      elapsed.count() / ((double)count * steps) << ", pairs tested per ball: " <<
+      (double)pairs_tested / ((double)count * steps) << ", contacts per ball: " << (double)pairs.size() / count <<
+      std::endl;
+  }
+
+  return EXIT_SUCCESS;
+}
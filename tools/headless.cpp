@@ -0,0 +1,148 @@
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+#include "logic.hpp"
+#include "profiler.hpp"
+#include "step_clock.hpp"
+#include "voice_mixer.hpp"
+
+namespace {
+
+int blocks_cleared = 0;
+int bounces = 0;
+int scores[kOwnedBallCount] {};
+
+// the sounds go through a mixer set up like the web frontend's, to see how many voice starts the events come to
+voice_mixer mixer(8);
+const int launch_sound = mixer.add_sound(0.1, 1);
+const int bounce_sound = mixer.add_sound(0.004, 0);
+const int loss_sound = mixer.add_sound(0.1, 2);
+
+void print_usage () {
+  std::cerr << "Usage: headless [--matches N] [--rows N] [--cols N] [--points N] [--max-frames N] [--step-rate HZ]" <<
+    std::endl << "                [--trace FILE]" << std::endl;
+}
+
+// the headless runner has no renderer or audio; it just tallies the events
+class tally_listener : public game_listener {
+public:
+  void clear_block (int, int) override {
+    ++blocks_cleared;
+  }
+
+  void play_launch (int) override {
+    mixer.request(launch_sound);
+  }
+
+  void play_bounce (int) override {
+    ++bounces;
+    mixer.request(bounce_sound);
+  }
+
+  void play_loss (int ball) override {
+    mixer.request(loss_sound);
+    // the ball hasn't been reattached to its paddle yet, so its position tells us which end it left through
+    ++scores[get_ball_y(ball) > 0.0f ? kPlayerBallIndex : kComputerBallIndex];
+  }
+};
+
+}
+
+int main (int argc, char** argv) {
+  int matches = 100;
+  int points = 5;
+  long max_frames = 0;
+  float step_rate = kDefaultStepRate;
+  int rows = kDefaultFieldRows;
+  int cols = kDefaultFieldCols;
+  const char* trace_path = nullptr;
+  for (auto i = 1; i < argc; ++i) {
+    if (i + 1 < argc && std::strcmp(argv[i], "--matches") == 0) matches = std::atoi(argv[++i]);
+    else if (i + 1 < argc && std::strcmp(argv[i], "--points") == 0) points = std::atoi(argv[++i]);
+    else if (i + 1 < argc && std::strcmp(argv[i], "--max-frames") == 0) max_frames = std::atol(argv[++i]);
+    else if (i + 1 < argc && std::strcmp(argv[i], "--step-rate") == 0) step_rate = std::atof(argv[++i]);
+    else if (i + 1 < argc && std::strcmp(argv[i], "--rows") == 0) rows = std::atoi(argv[++i]);
+    else if (i + 1 < argc && std::strcmp(argv[i], "--cols") == 0) cols = std::atoi(argv[++i]);
+    else if (i + 1 < argc && std::strcmp(argv[i], "--trace") == 0) trace_path = argv[++i];
+    else {
+      print_usage();
+      return EXIT_FAILURE;
+    }
+  }
+  if (!is_valid_step_rate(step_rate)) {
+    print_usage();
+    return EXIT_FAILURE;
+  }
+
+#ifndef PROFILER_ENABLED
+  if (trace_path) {
+    std::cerr << "--trace needs the profiler: configure with -DBREAKTHROUGH_PROFILER=ON" << std::endl;
+    return EXIT_FAILURE;
+  }
+#endif
+
+  set_player_autopilot(true);
+  tally_listener listener;
+  set_game_listener(&listener);
+  set_field_size(rows, cols);
+
+  // each simulated frame is one fixed step; by default, give up on a match after ten simulated minutes
+  auto step_duration = 1.0f / step_rate;
+  if (max_frames <= 0) max_frames = (long)(step_rate * 60.0f * 10.0f);
+
+  long total_frames = 0;
+  int wins[kOwnedBallCount] {};
+  int total_points[kOwnedBallCount] {};
+  auto start = std::chrono::steady_clock::now();
+  for (auto match = 0; match < matches; ++match) {
+    reset_game();
+    scores[kComputerBallIndex] = scores[kPlayerBallIndex] = 0;
+    long frame = 0;
+    for (; frame < max_frames && scores[kComputerBallIndex] < points && scores[kPlayerBallIndex] < points; ++frame) {
+      tick(step_duration);
+      mixer.mix((total_frames + frame) * (double)step_duration);
+      PROFILE_END_FRAME();
+    }
+    total_frames += frame;
+    for (auto side = 0; side < kOwnedBallCount; ++side) total_points[side] += scores[side];
+    if (scores[kComputerBallIndex] != scores[kPlayerBallIndex]) {
+      ++wins[scores[kComputerBallIndex] > scores[kPlayerBallIndex] ? kComputerBallIndex : kPlayerBallIndex];
+    }
+  }
+  std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+  std::cout << "matches: " << matches << std::endl;
+  std::cout << "wins (top/bottom): " << wins[kComputerBallIndex] << "/" << wins[kPlayerBallIndex] << std::endl;
+  std::cout << "points (top/bottom): " << total_points[kComputerBallIndex] << "/" <<
+    total_points[kPlayerBallIndex] << std::endl;
+  std::cout << "blocks cleared: " << blocks_cleared << std::endl;
+  std::cout << "bounces: " << bounces << std::endl;
+  auto& sounds = mixer.get_metrics();
+  std::cout << "sounds: " << sounds.requests << " requested, " << sounds.starts << " voices started (" <<
+    sounds.steals << " stolen, " << sounds.drops << " dropped)" << std::endl;
+  std::cout << "simulated frames: " << total_frames << std::endl;
+  std::cout << "elapsed seconds: " << elapsed.count() << std::endl;
+  std::cout << "frames per second: " << total_frames / elapsed.count() << std::endl;
+
+#ifdef PROFILER_ENABLED
+  // the frame history only covers the last few hundred frames, so this describes the end of the last match
+  std::cout << "recent frames (p50/p90/p99):" << std::endl;
+  for (auto& stats : profiler::get_frame_stats()) {
+    std::cout << "  " << stats.name << ": " << stats.p50 << "/" << stats.p90 << "/" << stats.p99 <<
+      (stats.counter ? "" : " ms") << std::endl;
+  }
+  if (trace_path) {
+    std::ofstream trace(trace_path);
+    profiler::write_trace(trace);
+    if (!trace) {
+      std::cerr << "Failed to write " << trace_path << std::endl;
+      return EXIT_FAILURE;
+    }
+  }
+#endif
+
+  return EXIT_SUCCESS;
+}
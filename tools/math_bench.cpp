@@ -0,0 +1,167 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include "vec_math.hpp"
+
+namespace {
+
+// the packed operations are built from the same IEEE operations as the scalar ones, so they should agree exactly;
+// this leaves room for a platform that fuses a multiply and add in one but not the other
+constexpr float kTolerance = 1e-6f;
+
+void print_usage () {
+  std::cerr << "Usage: math_bench [--count N] [--repeat N] [--seed N]" << std::endl;
+}
+
+struct vectors {
+  std::vector<float> x, y;
+};
+
+vectors make_vectors (int count, std::default_random_engine& engine, bool unit) {
+  std::uniform_real_distribution<float> distribution(-1.0f, 1.0f);
+  vectors out;
+  for (auto i = 0; i < count; ++i) {
+    vec2 v;
+    do v = vec2(distribution(engine), distribution(engine)); while (v.length_squared() < 1e-4f);
+    if (unit) v = v.normalize();
+    out.x.push_back(v.x);
+    out.y.push_back(v.y);
+  }
+  return out;
+}
+
+float max_difference (const vectors& a, const vectors& b) {
+  auto difference = 0.0f;
+  for (std::size_t i = 0; i < a.x.size(); ++i) {
+    difference = std::max({difference, std::abs(a.x[i] - b.x[i]), std::abs(a.y[i] - b.y[i])});
+  }
+  return difference;
+}
+
+// runs fn over a fresh copy of the input each time, returning nanoseconds per vector and leaving the last result
+template<typename F>
+double time_batch (const vectors& input, vectors& output, int repeat, F fn) {
+  std::chrono::duration<double> elapsed(0.0);
+  for (auto run = 0; run < repeat; ++run) {
+    output = input;
+    auto start = std::chrono::steady_clock::now();
+    fn(output);
+    elapsed += std::chrono::steady_clock::now() - start;
+  }
+  return elapsed.count() * 1e9 / ((double)repeat * input.x.size());
+}
+
+void normalize_hypot (vectors& v) {
+  for (std::size_t i = 0; i < v.x.size(); ++i) {
+    auto length = std::hypot(v.x[i], v.y[i]);
+    v.x[i] /= length;
+    v.y[i] /= length;
+  }
+}
+
+void normalize_scalar (vectors& v) {
+  for (std::size_t i = 0; i < v.x.size(); ++i) {
+    auto n = vec2(v.x[i], v.y[i]).normalize();
+    v.x[i] = n.x;
+    v.y[i] = n.y;
+  }
+}
+
+// runs the packed operation over whole groups of lanes and the scalar one over whatever's left
+template<typename P, typename S>
+void for_each_packed (vectors& v, P packed, S scalar) {
+  auto count = (int)v.x.size(), i = 0;
+  for (; i + simd::kWidth <= count; i += simd::kWidth) {
+    packed(i, vec2x4::load(&v.x[i], &v.y[i])).store(&v.x[i], &v.y[i]);
+  }
+  for (; i < count; ++i) {
+    auto r = scalar(i, vec2(v.x[i], v.y[i]));
+    v.x[i] = r.x;
+    v.y[i] = r.y;
+  }
+}
+
+}
+
+// checks the vector math against the scalar path (and the compile-time trig against the library's), then times them
+int main (int argc, char** argv) {
+  auto count = 4096;
+  auto repeat = 2000;
+  unsigned seed = 1;
+  for (auto i = 1; i < argc; ++i) {
+    if (i + 1 < argc && std::strcmp(argv[i], "--count") == 0) count = std::atoi(argv[++i]);
+    else if (i + 1 < argc && std::strcmp(argv[i], "--repeat") == 0) repeat = std::atoi(argv[++i]);
+    else if (i + 1 < argc && std::strcmp(argv[i], "--seed") == 0) seed = std::strtoul(argv[++i], nullptr, 10);
+    else {
+      print_usage();
+      return EXIT_FAILURE;
+    }
+  }
+  count = std::max(count, 1);
+  repeat = std::max(repeat, 1);
+
+  auto passed = true;
+  auto check = [&](const char* name, double error, double tolerance) {
+    std::cout << name << ": max error " << error << std::endl;
+    if (error > tolerance) {
+      std::cerr << name << " is out by more than " << tolerance << std::endl;
+      passed = false;
+    }
+  };
+
+  auto trig_error = 0.0;
+  for (auto step = 0; step <= 64; ++step) {
+    auto angle = kPi * 0.5 * step / 64;
+    trig_error = std::max({trig_error, std::abs(constexpr_sin(angle) - std::sin(angle)),
+      std::abs(constexpr_cos(angle) - std::cos(angle))});
+  }
+  check("constexpr sin/cos (0 to pi/2)", trig_error, 1e-12);
+
+  std::default_random_engine engine(seed);
+  auto input = make_vectors(count, engine, false);
+  auto normals = make_vectors(count, engine, true);
+
+  vectors hypot_result, scalar_result, packed_result;
+  auto hypot_ns = time_batch(input, hypot_result, repeat, normalize_hypot);
+  auto scalar_ns = time_batch(input, scalar_result, repeat, normalize_scalar);
+  auto packed_ns = time_batch(input, packed_result, repeat, [](vectors& v) {
+    for_each_packed(v, [](int, const vec2x4& p) { return p.normalize(); }, [](int, const vec2& s) {
+      return s.normalize();
+    });
+  });
+  check("packed normalize vs scalar", max_difference(packed_result, scalar_result), kTolerance);
+  check("scalar normalize vs hypot", max_difference(scalar_result, hypot_result), kTolerance);
+  auto length_error = 0.0f;
+  for (auto i = 0; i < count; ++i) {
+    length_error = std::max(length_error, std::abs(vec2(packed_result.x[i], packed_result.y[i]).length() - 1.0f));
+  }
+  check("packed normalized length", length_error, kTolerance);
+  std::cout << "normalize: " << hypot_ns << " ns with hypot, " << scalar_ns << " ns scalar, " << packed_ns <<
+    " ns packed (per vector)" << std::endl;
+
+  auto reflect_scalar_ns = time_batch(input, scalar_result, repeat, [&](vectors& v) {
+    for (auto i = 0; i < count; ++i) {
+      auto r = vec2(v.x[i], v.y[i]).reflect(vec2(normals.x[i], normals.y[i]));
+      v.x[i] = r.x;
+      v.y[i] = r.y;
+    }
+  });
+  auto reflect_packed_ns = time_batch(input, packed_result, repeat, [&](vectors& v) {
+    for_each_packed(v, [&](int i, const vec2x4& p) {
+      return p.reflect(vec2x4::load(&normals.x[i], &normals.y[i]));
+    }, [&](int i, const vec2& s) {
+      return s.reflect(vec2(normals.x[i], normals.y[i]));
+    });
+  });
+  check("packed reflect vs scalar", max_difference(packed_result, scalar_result), kTolerance);
+  std::cout << "reflect: " << reflect_scalar_ns << " ns scalar, " << reflect_packed_ns << " ns packed (per vector)" <<
+    std::endl;
+
+  return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,232 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <memory>
+#include <random>
+#include <vector>
+
+#include "logic.hpp"
+#include "render_commands.hpp"
+#include "replay.hpp"
+#include "snapshot_ring.hpp"
+#include "step_clock.hpp"
+
+namespace {
+
+struct replay_options {
+  const char* path = nullptr;
+  int repeat = 1;
+  int rollback = 0;
+
+  // "null" queues and sorts each step's draw commands for the cost of it, "record" also hashes them
+  const char* render = nullptr;
+
+  // for recording
+  const char* record_path = nullptr;
+  unsigned seed = 1;
+  long steps = 0;
+  float step_rate = kDefaultStepRate;
+  int rows = kDefaultFieldRows;
+  int cols = kDefaultFieldCols;
+};
+
+void print_usage () {
+  std::cerr << "Usage: replay FILE [--repeat N] [--rollback STEPS] [--render null|record]" << std::endl;
+  std::cerr << "       replay --record FILE [--seed N] [--steps N] [--step-rate HZ] [--rows N] [--cols N]" << std::endl;
+}
+
+bool parse_options (int argc, char** argv, replay_options& options) {
+  for (auto i = 1; i < argc; ++i) {
+    if (i + 1 < argc && std::strcmp(argv[i], "--record") == 0) options.record_path = argv[++i];
+    else if (i + 1 < argc && std::strcmp(argv[i], "--repeat") == 0) options.repeat = std::atoi(argv[++i]);
+    else if (i + 1 < argc && std::strcmp(argv[i], "--rollback") == 0) options.rollback = std::atoi(argv[++i]);
+    else if (i + 1 < argc && std::strcmp(argv[i], "--render") == 0) options.render = argv[++i];
+    else if (i + 1 < argc && std::strcmp(argv[i], "--seed") == 0) options.seed = std::strtoul(argv[++i], nullptr, 10);
+    else if (i + 1 < argc && std::strcmp(argv[i], "--steps") == 0) options.steps = std::atol(argv[++i]);
+    else if (i + 1 < argc && std::strcmp(argv[i], "--step-rate") == 0) options.step_rate = std::atof(argv[++i]);
+    else if (i + 1 < argc && std::strcmp(argv[i], "--rows") == 0) options.rows = std::atoi(argv[++i]);
+    else if (i + 1 < argc && std::strcmp(argv[i], "--cols") == 0) options.cols = std::atoi(argv[++i]);
+    else if (!options.path && argv[i][0] != '-') options.path = argv[i];
+    else return false;
+  }
+  if (options.render && std::strcmp(options.render, "null") != 0 && std::strcmp(options.render, "record") != 0) {
+    return false;
+  }
+  return (options.path != nullptr) != (options.record_path != nullptr) && options.repeat > 0 && options.rollback >= 0 &&
+    is_valid_step_rate(options.step_rate);
+}
+
+// collects the blocks cleared for the draws to upload, as the browser does; steps played again after a rollback clear
+// the same blocks over, and are ignored
+struct block_listener : public game_listener {
+  block_changes blocks;
+  bool resimulating = false;
+
+  void clear_block (int row, int col) override { if (!resimulating) blocks.clear_block(row, col); }
+};
+
+// sets up a game the way the recording session started
+void start_game (game& match, const replay& session) {
+  match.seed(session.seed);
+  match.set_field_size(session.rows, session.cols);
+  match.set_prediction_depth(kComputerBallIndex, session.prediction_depth);
+  match.reset();
+}
+
+void run_step (game& match, const replay_step& step, float step_duration) {
+  match.set_player_position(step.player_position);
+  if (step.release) match.maybe_release_player_ball();
+  match.tick(step_duration);
+}
+
+// stands in for a player: chases the ball heading its way that's nearest its paddle, lagging behind a little, and
+// launches its ball after a random wait
+int record (const replay_options& options) {
+  game_listener listener;
+  replay session {};
+  session.seed = options.seed;
+  session.step_rate = options.step_rate;
+  session.rows = std::max(options.rows, 1);
+  session.cols = std::max(options.cols, 1);
+  session.prediction_depth = kDefaultPredictionDepth;
+  game match(listener);
+  start_game(match, session);
+
+  auto step_duration = step_clock(session.step_rate).get_step_duration();
+  auto steps = (options.steps > 0) ? options.steps : (long)(session.step_rate * 60.0f);
+  std::default_random_engine engine(options.seed);
+  std::uniform_real_distribution<float> jitter(-0.02f, 0.02f);
+  std::bernoulli_distribution release(0.01);
+
+  replay_recorder recorder;
+  recorder.begin(session.seed, session.step_rate, match.get_field_rows(), match.get_field_cols(),
+    session.prediction_depth);
+  auto position = 0.0f;
+  for (long step = 0; step < steps; ++step) {
+    auto target = position, nearest_y = 0.0f;
+    for (auto ball = 0, count = match.get_ball_count(); ball < count; ++ball) {
+      auto y = match.get_ball_y(ball), previous_y = match.get_ball_y(ball, 0.0f);
+      if (y < previous_y && y < nearest_y) {
+        nearest_y = y;
+        target = match.get_ball_x(ball);
+      }
+    }
+    position += (target + jitter(engine) - position) * 0.2f;
+    auto released = release(engine);
+    match.set_player_position(recorder.record_step(position, released));
+    if (released) match.maybe_release_player_ball();
+    match.tick(step_duration);
+  }
+
+  auto data = recorder.finish(match.get_state_hash());
+  std::ofstream out(options.record_path, std::ios::binary);
+  out.write(reinterpret_cast<const char*>(data.data()), data.size());
+  if (!out) {
+    std::cerr << "Failed to write " << options.record_path << std::endl;
+    return EXIT_FAILURE;
+  }
+  std::cout << "steps: " << steps << std::endl;
+  std::cout << "bytes: " << data.size() << std::endl;
+  std::cout << "final hash: " << std::hex << match.get_state_hash() << std::dec << std::endl;
+  return EXIT_SUCCESS;
+}
+
+// re-simulates the session as fast as possible, checking that it ends up where the recording did
+int play (const replay_options& options) {
+  std::ifstream in(options.path, std::ios::binary);
+  std::vector<unsigned char> data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+  replay session;
+  if (!decode_replay(data.data(), data.size(), session)) {
+    std::cerr << "Failed to read a replay from " << options.path << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  block_listener listener;
+  game match(listener);
+  start_game(match, session);
+  auto step_duration = step_clock(session.step_rate).get_step_duration();
+  auto matched = true;
+  std::chrono::duration<double> elapsed(0.0);
+
+  // with --rollback, every step first rewinds that many steps and plays them again (saving each as it goes), the
+  // way a rollback netcode session would on a late input each frame; the result must come out the same
+  auto rollback = (long)options.rollback;
+  snapshot_ring snapshots(options.rollback + 1, match);
+
+  // with --render, every step is drawn as the browser would at the end of it, minus the GL; the recorded hash of
+  // the draws is the same from run to run, so it can be kept to check the output against
+  std::unique_ptr<render_backend> backend;
+  sim_frame frame;
+  frame_options draw_options;
+  command_buffer commands;
+  for (auto run = 0; run < options.repeat; ++run) {
+    start_game(match, session);
+    listener.blocks.reset(match.get_field_rows(), match.get_field_cols());
+    draw_options.wall_dirty = true;
+    snapshots.clear();
+    if (options.render && std::strcmp(options.render, "null") == 0) backend.reset(new null_render_backend());
+    else if (options.render) backend.reset(new recording_render_backend());
+    auto start = std::chrono::steady_clock::now();
+    for (long step = 0, count = (long)session.steps.size(); step < count; ++step) {
+      if (rollback > 0) {
+        if (step >= rollback) {
+          snapshots.load(match, step - rollback);
+          listener.resimulating = true;
+          for (auto resimulated = step - rollback; resimulated < step; ++resimulated) {
+            snapshots.save(match, resimulated);
+            run_step(match, session.steps[resimulated], step_duration);
+          }
+          listener.resimulating = false;
+        }
+        snapshots.save(match, step);
+      }
+      run_step(match, session.steps[step], step_duration);
+      if (backend) {
+        frame.capture(match, step, 0.0);
+        draw_options.player_position = session.steps[step].player_position;
+        commands.clear();
+        queue_frame(frame, draw_options, listener.blocks, commands);
+        commands.submit(*backend);
+        draw_options.wall_dirty = false;
+      }
+    }
+    elapsed += std::chrono::steady_clock::now() - start;
+    if (match.get_state_hash() != session.final_hash) matched = false;
+  }
+
+  auto total_steps = (double)session.steps.size() * options.repeat;
+  std::cout << "steps: " << session.steps.size() << " (" << session.steps.size() / session.step_rate <<
+    " simulated seconds)" << std::endl;
+  std::cout << "final hash: " << std::hex << match.get_state_hash() << " (recorded " << session.final_hash << ")" <<
+    std::dec << std::endl;
+  std::cout << "elapsed seconds: " << elapsed.count() << std::endl;
+  std::cout << "steps per second: " << total_steps / elapsed.count() << std::endl;
+  if (rollback > 0) {
+    std::cout << "microseconds per step with a " << rollback << "-step rollback: " <<
+      elapsed.count() * 1e6 / total_steps << std::endl;
+  }
+  if (auto recording = dynamic_cast<recording_render_backend*>(backend.get())) {
+    std::cout << "render hash: " << std::hex << recording->get_hash() << std::dec << " (" <<
+      recording->get_frame_count() << " frames)" << std::endl;
+  }
+  if (!matched) {
+    std::cerr << "Replay diverged from the recording" << std::endl;
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
+
+}
+
+int main (int argc, char** argv) {
+  replay_options options;
+  if (!parse_options(argc, argv, options)) {
+    print_usage();
+    return EXIT_FAILURE;
+  }
+  return options.record_path ? record(options) : play(options);
+}
@@ -0,0 +1,189 @@
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include "logic.hpp"
+#include "loopback_transport.hpp"
+#include "rollback_session.hpp"
+#include "step_clock.hpp"
+
+namespace {
+
+struct rollback_options {
+  long frames = 0;
+  float step_rate = kDefaultStepRate;
+  unsigned seed = 1;
+  loopback_conditions conditions;
+  rollback_config config;
+};
+
+void print_usage () {
+  std::cerr << "Usage: rollback [--frames N] [--step-rate HZ] [--seed N]" << std::endl;
+  std::cerr << "                [--latency MS] [--jitter MS] [--loss PERCENT]" << std::endl;
+  std::cerr << "                [--delay FRAMES] [--prediction FRAMES]" << std::endl;
+}
+
+bool parse_options (int argc, char** argv, rollback_options& options) {
+  auto latency_ms = options.conditions.latency * 1000.0, jitter_ms = options.conditions.jitter * 1000.0;
+  auto loss_percent = options.conditions.loss * 100.0;
+  auto& config = options.config;
+  for (auto i = 1; i < argc; ++i) {
+    if (i + 1 < argc && std::strcmp(argv[i], "--frames") == 0) options.frames = std::atol(argv[++i]);
+    else if (i + 1 < argc && std::strcmp(argv[i], "--step-rate") == 0) options.step_rate = std::atof(argv[++i]);
+    else if (i + 1 < argc && std::strcmp(argv[i], "--seed") == 0) options.seed = std::strtoul(argv[++i], nullptr, 10);
+    else if (i + 1 < argc && std::strcmp(argv[i], "--latency") == 0) latency_ms = std::atof(argv[++i]);
+    else if (i + 1 < argc && std::strcmp(argv[i], "--jitter") == 0) jitter_ms = std::atof(argv[++i]);
+    else if (i + 1 < argc && std::strcmp(argv[i], "--loss") == 0) loss_percent = std::atof(argv[++i]);
+    else if (i + 1 < argc && std::strcmp(argv[i], "--delay") == 0) config.input_delay = std::atoi(argv[++i]);
+    else if (i + 1 < argc && std::strcmp(argv[i], "--prediction") == 0) config.max_prediction = std::atoi(argv[++i]);
+    else return false;
+  }
+  options.conditions.latency = latency_ms / 1000.0;
+  options.conditions.jitter = jitter_ms / 1000.0;
+  options.conditions.loss = loss_percent / 100.0;
+  return is_valid_step_rate(options.step_rate);
+}
+
+// stands in for a human at one end: chases the ball heading its way that's nearest its paddle, lagging behind a
+// little, and launches its ball after a random wait
+class scripted_player {
+public:
+  scripted_player (int side, unsigned seed) : side_(side), engine_(seed) {}
+
+  void choose (const game& view, float& position, bool& release) {
+    auto direction = (side_ == kComputerBallIndex) ? 1.0f : -1.0f;
+    auto target = position_, nearest = 0.0f;
+    for (auto ball = 0, count = view.get_ball_count(); ball < count; ++ball) {
+      auto y = view.get_ball_y(ball) * direction, previous_y = view.get_ball_y(ball, 0.0f) * direction;
+      if (y > previous_y && y > nearest) {
+        nearest = y;
+        target = view.get_ball_x(ball);
+      }
+    }
+    position_ += (target + std::uniform_real_distribution<float>(-0.02f, 0.02f)(engine_) - position_) * 0.2f;
+    position = position_;
+    release = std::bernoulli_distribution(0.02)(engine_);
+  }
+
+private:
+  int side_;
+  std::default_random_engine engine_;
+  float position_ = 0.0f;
+};
+
+// keeps a copy of the field from the events alone, as a renderer would, to check it against the game's
+class display_listener : public game_listener {
+public:
+  explicit display_listener (const game& view) :
+    cols_(view.get_field_cols()),
+    cleared_(view.get_field_rows() * cols_) {}
+
+  void clear_block (int row, int col) override { cleared_[row * cols_ + col] = true; }
+  void restore_block (int row, int col) override { cleared_[row * cols_ + col] = false; }
+
+  bool matches (const game& view) const {
+    for (auto row = 0, rows = view.get_field_rows(); row < rows; ++row) {
+      for (auto col = 0; col < cols_; ++col) {
+        if (cleared_[row * cols_ + col] != view.get_block_state(row, col)) return false;
+      }
+    }
+    return true;
+  }
+
+private:
+  int cols_;
+  std::vector<bool> cleared_;
+};
+
+void print_metrics (const char* name, const rollback_session& session, float step_rate) {
+  auto& metrics = session.get_metrics();
+  auto seconds = metrics.frames / step_rate;
+  std::cout << name << ":" << std::endl;
+  std::cout << "  frames: " << metrics.frames << " (" << metrics.stalls << " stalled)" << std::endl;
+  std::cout << "  rollbacks: " << metrics.rollbacks << " (" << metrics.rollbacks / seconds << " per second, longest " <<
+    metrics.longest_rollback << " frames)" << std::endl;
+  std::cout << "  resimulated frames: " << metrics.resimulated_frames << " (" << metrics.resimulated_frames / seconds <<
+    " per second of play)" << std::endl;
+  if (metrics.resimulated_frames > 0) {
+    std::cout << "  resimulation: " << metrics.resimulation_seconds * 1e6 / metrics.resimulated_frames <<
+      " microseconds per frame (" << metrics.resimulated_frames / metrics.resimulation_seconds <<
+      " frames per second)" << std::endl;
+  }
+  auto average_ms = [](double seconds, long count) { return count ? seconds * 1000.0 / count : 0.0; };
+  std::cout << "  input to display: " << average_ms(metrics.local_input_latency_seconds, metrics.local_inputs) <<
+    " ms local, " << average_ms(metrics.remote_input_latency_seconds, metrics.remote_inputs) <<
+    " ms remote (average)" << std::endl;
+}
+
+}
+
+// plays a two-human game between scripted players over a loopback link, in simulated real time, then checks that
+// both ends agree on the outcome
+int main (int argc, char** argv) {
+  rollback_options options;
+  if (!parse_options(argc, argv, options)) {
+    print_usage();
+    return EXIT_FAILURE;
+  }
+  if (options.frames <= 0) options.frames = (long)(options.step_rate * 60.0f);
+
+  loopback_link link(options.conditions, options.seed);
+  game_listener nobody;
+  game field_size(nobody);
+  display_listener displays[] {display_listener(field_size), display_listener(field_size)};
+  const int sides[] {kPlayerBallIndex, kComputerBallIndex};
+  rollback_session bottom(displays[0], link.get_end(0), sides[0], options.seed, options.step_rate, options.config);
+  rollback_session top(displays[1], link.get_end(1), sides[1], options.seed, options.step_rate, options.config);
+  rollback_session* sessions[] {&bottom, &top};
+  scripted_player players[] {{sides[0], options.seed * 2 + 1}, {sides[1], options.seed * 2 + 2}};
+
+  // each peer gets a chance to run a frame per frame of time, running late when it stalls
+  auto frame_time = 1.0 / options.step_rate;
+  while ((bottom.get_frame() < options.frames || top.get_frame() < options.frames) && !bottom.is_desynced() &&
+      !top.is_desynced()) {
+    link.advance_time(frame_time);
+    for (auto peer = 0; peer < 2; ++peer) {
+      auto& session = *sessions[peer];
+      if (session.get_frame() >= options.frames) {
+        session.poll();
+        continue;
+      }
+      float position;
+      bool release;
+      players[peer].choose(session.get_game(), position, release);
+      session.advance(position, release);
+    }
+  }
+
+  // let the last of the input through, so that both have run every frame with the real thing
+  for (auto wait = 0.0; wait < 10.0; wait += frame_time) {
+    if (bottom.get_confirmed_frame() == options.frames && top.get_confirmed_frame() == options.frames) break;
+    link.advance_time(frame_time);
+    bottom.poll();
+    top.poll();
+  }
+
+  print_metrics("bottom", bottom, options.step_rate);
+  print_metrics("top", top, options.step_rate);
+  std::cout << "packets: " << link.get_packets_sent() << " (" << link.get_packets_dropped() << " dropped)" << std::endl;
+
+  if (bottom.is_desynced() || top.is_desynced()) {
+    std::cerr << "Peers desynced: a rollback's snapshot had already been overwritten" << std::endl;
+    return EXIT_FAILURE;
+  }
+  auto bottom_hash = bottom.get_game().get_state_hash(), top_hash = top.get_game().get_state_hash();
+  std::cout << "final hashes: " << std::hex << bottom_hash << " " << top_hash << std::dec << std::endl;
+  if (bottom_hash != top_hash || bottom.get_confirmed_frame() != options.frames ||
+      top.get_confirmed_frame() != options.frames) {
+    std::cerr << "Peers diverged" << std::endl;
+    return EXIT_FAILURE;
+  }
+  if (!displays[0].matches(bottom.get_game()) || !displays[1].matches(top.get_game())) {
+    std::cerr << "Displayed field differs from the game's" << std::endl;
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
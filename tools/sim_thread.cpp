@@ -0,0 +1,124 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <thread>
+
+#include "logic.hpp"
+#include "replay.hpp"
+#include "sim_worker.hpp"
+#include "step_clock.hpp"
+
+namespace {
+
+struct sim_thread_options {
+  double seconds = 5.0;
+  float step_rate = kDefaultStepRate;
+  float frame_rate = 60.0f;
+  unsigned seed = 1;
+
+  // every so often the "main thread" stalls, the way a browser tab does for garbage collection or a slow GL call
+  int stall_every = 30;
+  double stall_ms = 100.0;
+};
+
+void print_usage () {
+  std::cerr << "Usage: sim_thread [--seconds S] [--step-rate HZ] [--frame-rate HZ] [--seed N]" << std::endl;
+  std::cerr << "                  [--stall-every FRAMES] [--stall-ms MS]" << std::endl;
+}
+
+// plays the replay through on a fresh game, returning true if it ends in the recorded state
+bool verify_replay (const std::vector<unsigned char>& data) {
+  replay session;
+  if (!decode_replay(data.data(), data.size(), session)) return false;
+  game_listener listener;
+  game match(listener, session.seed);
+  match.set_field_size(session.rows, session.cols);
+  match.set_prediction_depth(kComputerBallIndex, session.prediction_depth);
+  match.reset();
+  auto step_duration = step_clock(session.step_rate).get_step_duration();
+  for (auto& step : session.steps) {
+    match.set_player_position(step.player_position);
+    if (step.release) match.maybe_release_player_ball();
+    match.tick(step_duration);
+  }
+  std::cout << "replayed steps: " << session.steps.size() << std::endl;
+  return match.get_state_hash() == session.final_hash;
+}
+
+}
+
+// stands in for the web frontend of a threaded build: renders (reads frames) at the frame rate, stalling now and
+// then, while the worker simulates; afterwards, checks the worker's recording against a single-threaded replay
+int main (int argc, char** argv) {
+  sim_thread_options options;
+  for (auto i = 1; i < argc; ++i) {
+    if (i + 1 < argc && std::strcmp(argv[i], "--seconds") == 0) options.seconds = std::atof(argv[++i]);
+    else if (i + 1 < argc && std::strcmp(argv[i], "--step-rate") == 0) options.step_rate = std::atof(argv[++i]);
+    else if (i + 1 < argc && std::strcmp(argv[i], "--frame-rate") == 0) options.frame_rate = std::atof(argv[++i]);
+    else if (i + 1 < argc && std::strcmp(argv[i], "--seed") == 0) options.seed = std::strtoul(argv[++i], nullptr, 10);
+    else if (i + 1 < argc && std::strcmp(argv[i], "--stall-every") == 0) options.stall_every = std::atoi(argv[++i]);
+    else if (i + 1 < argc && std::strcmp(argv[i], "--stall-ms") == 0) options.stall_ms = std::atof(argv[++i]);
+    else {
+      print_usage();
+      return EXIT_FAILURE;
+    }
+  }
+  if (!is_valid_step_rate(options.step_rate)) {
+    print_usage();
+    return EXIT_FAILURE;
+  }
+
+  sim_worker worker(options.seed, options.step_rate);
+  long frames = 0, events = 0, blocks_cleared = 0, largest_step_gap = 0;
+  auto position = 0.0f;
+  auto last_step = 0L;
+  auto start = sim_worker::now();
+  worker.start();
+  while (sim_worker::now() - start < options.seconds) {
+    std::this_thread::sleep_for(std::chrono::duration<double>(1.0 / options.frame_rate));
+    if (options.stall_every > 0 && ++frames % options.stall_every == 0) {
+      std::this_thread::sleep_for(std::chrono::duration<double>(options.stall_ms / 1000.0));
+    }
+
+    auto& frame = worker.acquire_frame();
+    largest_step_gap = std::max(largest_step_gap, frame.step - last_step);
+    last_step = frame.step;
+    worker.drain_events([&](const sim_event& event) {
+      ++events;
+      if (event.kind == sim_event::kClearBlock) ++blocks_cleared;
+    });
+
+    // chase the lowest ball heading down, and keep launching
+    auto target = position, lowest = 0.0f;
+    for (auto ball = 0; ball < frame.ball_count; ++ball) {
+      if (frame.y[ball] < frame.previous_y[ball] && frame.y[ball] < lowest) {
+        lowest = frame.y[ball];
+        target = frame.x[ball];
+      }
+    }
+    position += (target - position) * 0.3f;
+    worker.send_input(position, true);
+  }
+
+  // the worker encodes the replay between steps; wait for it, then stop
+  worker.request_replay();
+  auto data = worker.take_replay();
+  for (; !data; data = worker.take_replay()) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  worker.stop();
+  auto elapsed = sim_worker::now() - start;
+
+  std::cout << "elapsed seconds: " << elapsed << std::endl;
+  std::cout << "steps simulated: " << worker.get_step() << " (" << worker.get_step() / elapsed << " per second, " <<
+    options.step_rate << " wanted)" << std::endl;
+  std::cout << "frames drawn: " << frames << " (" << frames / elapsed << " per second)" << std::endl;
+  std::cout << "most steps between frames: " << largest_step_gap << std::endl;
+  std::cout << "events: " << events << " (" << blocks_cleared << " block clears)" << std::endl;
+  if (!verify_replay(*data)) {
+    std::cerr << "The threaded run doesn't match its replay" << std::endl;
+    return EXIT_FAILURE;
+  }
+  std::cout << "replay matches" << std::endl;
+  return EXIT_SUCCESS;
+}
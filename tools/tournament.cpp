@@ -0,0 +1,205 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+#include "logic.hpp"
+#include "step_clock.hpp"
+#include "task_pool.hpp"
+
+namespace {
+
+struct tournament_options {
+  int matches = 10000;
+  int points = 5;
+  long max_frames = 0;
+  float step_rate = kDefaultStepRate;
+  int rows = kDefaultFieldRows;
+  int cols = kDefaultFieldCols;
+  unsigned seed = 1;
+  int depths[kOwnedBallCount] {kDefaultPredictionDepth, kDefaultPredictionDepth};
+};
+
+// totals over a number of matches; merging batches in order keeps the aggregate independent of the scheduling
+struct tournament_totals {
+  int matches = 0;
+  int wins[kOwnedBallCount] {};
+  int points[kOwnedBallCount] {};
+  long frames = 0;
+  long blocks_cleared = 0;
+  long rallies = 0;
+  long rally_frames = 0;
+  long longest_rally_frames = 0;
+
+  void add (const tournament_totals& other) {
+    matches += other.matches;
+    for (auto side = 0; side < kOwnedBallCount; ++side) {
+      wins[side] += other.wins[side];
+      points[side] += other.points[side];
+    }
+    frames += other.frames;
+    blocks_cleared += other.blocks_cleared;
+    rallies += other.rallies;
+    rally_frames += other.rally_frames;
+    longest_rally_frames = std::max(longest_rally_frames, other.longest_rally_frames);
+  }
+};
+
+// tallies one game's events; a rally runs from a paddle's own ball being launched to its loss
+class match_recorder : public game_listener {
+public:
+  explicit match_recorder (tournament_totals& totals) : totals_(totals) {}
+
+  void set_game (const game* current) { game_ = current; }
+
+  void start_match () {
+    frame_ = 0;
+    scores_[kComputerBallIndex] = scores_[kPlayerBallIndex] = 0;
+  }
+
+  void advance_frame () { ++frame_; }
+  long get_frame () const { return frame_; }
+  int get_score (int side) const { return scores_[side]; }
+
+  void clear_block (int, int) override {
+    ++totals_.blocks_cleared;
+  }
+
+  void play_launch (int ball) override {
+    if (ball < kOwnedBallCount) launch_frames_[ball] = frame_;
+  }
+
+  void play_loss (int ball) override {
+    // the ball hasn't been reattached to its paddle yet, so its position tells us which end it left through
+    ++scores_[game_->get_ball_y(ball) > 0.0f ? kPlayerBallIndex : kComputerBallIndex];
+    if (ball >= kOwnedBallCount) return;
+    auto length = frame_ - launch_frames_[ball];
+    ++totals_.rallies;
+    totals_.rally_frames += length;
+    totals_.longest_rally_frames = std::max(totals_.longest_rally_frames, length);
+  }
+
+private:
+  tournament_totals& totals_;
+  const game* game_ = nullptr;
+  long frame_ = 0;
+  long launch_frames_[kOwnedBallCount] {};
+  int scores_[kOwnedBallCount] {};
+};
+
+// spreads consecutive match numbers across the seed space (splitmix32-style), since the opponents' engine would
+// otherwise start out nearly identically for neighbouring seeds
+unsigned get_match_seed (unsigned seed, int match) {
+  std::uint32_t value = seed * 0x9E3779B9u + (std::uint32_t)match;
+  value = (value ^ (value >> 16)) * 0x85EBCA6Bu;
+  value = (value ^ (value >> 13)) * 0xC2B2AE35u;
+  return value ^ (value >> 16);
+}
+
+// plays matches [first, first + count) with the computer on both sides
+void play_matches (const tournament_options& options, int first, int count, tournament_totals& totals) {
+  match_recorder recorder(totals);
+  game match(recorder);
+  recorder.set_game(&match);
+  match.set_player_autopilot(true);
+  match.set_field_size(options.rows, options.cols);
+  for (auto side = 0; side < kOwnedBallCount; ++side) match.set_prediction_depth(side, options.depths[side]);
+  auto step_duration = 1.0f / options.step_rate;
+
+  for (auto index = first; index < first + count; ++index) {
+    match.seed(get_match_seed(options.seed, index));
+    match.reset();
+    recorder.start_match();
+    while (recorder.get_frame() < options.max_frames && recorder.get_score(kComputerBallIndex) < options.points &&
+        recorder.get_score(kPlayerBallIndex) < options.points) {
+      match.tick(step_duration);
+      recorder.advance_frame();
+    }
+    ++totals.matches;
+    totals.frames += recorder.get_frame();
+    for (auto side = 0; side < kOwnedBallCount; ++side) totals.points[side] += recorder.get_score(side);
+    auto top = recorder.get_score(kComputerBallIndex), bottom = recorder.get_score(kPlayerBallIndex);
+    if (top != bottom) ++totals.wins[top > bottom ? kComputerBallIndex : kPlayerBallIndex];
+  }
+}
+
+void print_usage () {
+  std::cerr << "Usage: tournament [--matches N] [--threads N] [--batch N] [--seed N] [--rows N] [--cols N] " <<
+    "[--points N] [--max-frames N] [--step-rate HZ] [--top-depth N] [--bottom-depth N]" << std::endl;
+}
+
+}
+
+int main (int argc, char** argv) {
+  tournament_options options;
+  int threads = 0;
+  int batch = 64;
+  int top_depth = kDefaultPredictionDepth;
+  int bottom_depth = kDefaultPredictionDepth;
+  for (auto i = 1; i < argc; ++i) {
+    if (i + 1 < argc && std::strcmp(argv[i], "--matches") == 0) options.matches = std::atoi(argv[++i]);
+    else if (i + 1 < argc && std::strcmp(argv[i], "--threads") == 0) threads = std::atoi(argv[++i]);
+    else if (i + 1 < argc && std::strcmp(argv[i], "--batch") == 0) batch = std::max(1, std::atoi(argv[++i]));
+    else if (i + 1 < argc && std::strcmp(argv[i], "--seed") == 0) options.seed = std::strtoul(argv[++i], nullptr, 10);
+    else if (i + 1 < argc && std::strcmp(argv[i], "--rows") == 0) options.rows = std::atoi(argv[++i]);
+    else if (i + 1 < argc && std::strcmp(argv[i], "--cols") == 0) options.cols = std::atoi(argv[++i]);
+    else if (i + 1 < argc && std::strcmp(argv[i], "--points") == 0) options.points = std::atoi(argv[++i]);
+    else if (i + 1 < argc && std::strcmp(argv[i], "--max-frames") == 0) options.max_frames = std::atol(argv[++i]);
+    else if (i + 1 < argc && std::strcmp(argv[i], "--step-rate") == 0) options.step_rate = std::atof(argv[++i]);
+    else if (i + 1 < argc && std::strcmp(argv[i], "--top-depth") == 0) top_depth = std::atoi(argv[++i]);
+    else if (i + 1 < argc && std::strcmp(argv[i], "--bottom-depth") == 0) bottom_depth = std::atoi(argv[++i]);
+    else {
+      print_usage();
+      return EXIT_FAILURE;
+    }
+  }
+  if (!is_valid_step_rate(options.step_rate)) {
+    print_usage();
+    return EXIT_FAILURE;
+  }
+  options.depths[kComputerBallIndex] = top_depth;
+  options.depths[kPlayerBallIndex] = bottom_depth;
+
+  // by default, give up on a match (calling it a draw) after ten simulated minutes
+  if (options.max_frames <= 0) options.max_frames = (long)(options.step_rate * 60.0f * 10.0f);
+
+  // each task plays a batch of matches with a game of its own, writing to its own slot
+  std::vector<tournament_totals> batch_totals((options.matches + batch - 1) / batch);
+  auto start = std::chrono::steady_clock::now();
+  task_pool pool(threads);
+  for (auto index = 0; index < (int)batch_totals.size(); ++index) {
+    pool.submit([&, index] {
+      auto first = index * batch;
+      play_matches(options, first, std::min(batch, options.matches - first), batch_totals[index]);
+    });
+  }
+  pool.wait();
+  std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+  tournament_totals totals;
+  for (auto& batch_total : batch_totals) totals.add(batch_total);
+
+  auto to_seconds = [&](double frames) { return frames / options.step_rate; };
+  auto rate = [&](int count) { return totals.matches ? (double)count / totals.matches : 0.0; };
+  auto draws = totals.matches - totals.wins[kComputerBallIndex] - totals.wins[kPlayerBallIndex];
+  std::cout << "matches: " << totals.matches << " (" << pool.get_thread_count() << " threads)" << std::endl;
+  std::cout << "wins (top/bottom): " << totals.wins[kComputerBallIndex] << "/" << totals.wins[kPlayerBallIndex] <<
+    " (" << rate(totals.wins[kComputerBallIndex]) << "/" << rate(totals.wins[kPlayerBallIndex]) << ")" << std::endl;
+  std::cout << "draws: " << draws << " (" << rate(draws) << ")" << std::endl;
+  std::cout << "points (top/bottom): " << totals.points[kComputerBallIndex] << "/" <<
+    totals.points[kPlayerBallIndex] << std::endl;
+  std::cout << "mean match seconds: " << to_seconds(totals.frames) / std::max(totals.matches, 1) << std::endl;
+  std::cout << "rallies: " << totals.rallies << std::endl;
+  std::cout << "mean rally seconds: " << to_seconds(totals.rally_frames) / std::max(totals.rallies, 1l) << std::endl;
+  std::cout << "longest rally seconds: " << to_seconds(totals.longest_rally_frames) << std::endl;
+  std::cout << "blocks cleared per minute: " <<
+    totals.blocks_cleared / std::max(to_seconds(totals.frames) / 60.0, 1e-9) << std::endl;
+  std::cout << "simulated frames: " << totals.frames << std::endl;
+  std::cout << "elapsed seconds: " << elapsed.count() << std::endl;
+  std::cout << "matches per second: " << totals.matches / elapsed.count() << std::endl;
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,85 @@
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+#include "fnv_hash.hpp"
+#include "vec_env.hpp"
+
+namespace {
+
+void print_usage () {
+  std::cerr << "Usage: vec_env_bench [--envs N] [--steps N] [--threads N] [--batch N] [--seed N]" << std::endl;
+}
+
+// a stand-in for a learned policy, working only from the observation: follows the ball heading up that's highest
+void choose_actions (const vec_env& env, const float* observations, float* actions, int max_balls) {
+  for (auto index = 0; index < env.get_count(); ++index) {
+    auto observation = observations + index * env.get_observation_size();
+    auto action = actions + index * vec_env::kActionSize;
+    auto target = observation[0], highest = 0.0f;
+    for (auto ball = 0; ball < max_balls; ++ball) {
+      auto state = observation + 2 + ball * 5;
+      if (state[4] > 0.0f && state[3] > 0.0f && state[1] > highest) {
+        highest = state[1];
+        target = state[0];
+      }
+    }
+    action[0] = observation[0] + (target - observation[0]) * 0.3f;
+    action[1] = 1.0f;
+  }
+}
+
+}
+
+// steps a batch of environments with a scripted policy and reports the environment steps per second; the results
+// for a given seed don't depend on the thread count or batch size
+int main (int argc, char** argv) {
+  auto count = 4096;
+  long steps = 1000;
+  auto threads = 0;
+  unsigned seed = 1;
+  vec_env_config config;
+  for (auto i = 1; i < argc; ++i) {
+    if (i + 1 < argc && std::strcmp(argv[i], "--envs") == 0) count = std::atoi(argv[++i]);
+    else if (i + 1 < argc && std::strcmp(argv[i], "--steps") == 0) steps = std::atol(argv[++i]);
+    else if (i + 1 < argc && std::strcmp(argv[i], "--threads") == 0) threads = std::atoi(argv[++i]);
+    else if (i + 1 < argc && std::strcmp(argv[i], "--batch") == 0) config.batch_size = std::atoi(argv[++i]);
+    else if (i + 1 < argc && std::strcmp(argv[i], "--seed") == 0) seed = std::strtoul(argv[++i], nullptr, 10);
+    else {
+      print_usage();
+      return EXIT_FAILURE;
+    }
+  }
+
+  vec_env env(count, config, threads);
+  count = env.get_count();
+  std::vector<unsigned> seeds(count);
+  for (auto index = 0; index < count; ++index) seeds[index] = seed + index;
+  std::vector<float> observations(count * env.get_observation_size());
+  std::vector<float> actions(count * vec_env::kActionSize), rewards(count), dones(count);
+  env.reset(seeds.data(), observations.data());
+
+  double total_reward = 0.0;
+  std::chrono::duration<double> stepping(0.0);
+  for (long step = 0; step < steps; ++step) {
+    choose_actions(env, observations.data(), actions.data(), config.max_balls);
+    auto start = std::chrono::steady_clock::now();
+    env.step(actions.data(), observations.data(), rewards.data(), dones.data());
+    stepping += std::chrono::steady_clock::now() - start;
+    for (auto reward : rewards) total_reward += reward;
+  }
+
+  fnv_hasher hash;
+  hash.add(observations, (int)observations.size());
+
+  std::cout << "environments: " << count << " (" << env.get_observation_size() << " floats observed each)" << std::endl;
+  std::cout << "steps: " << steps << std::endl;
+  std::cout << "episodes finished: " << env.get_episodes_finished() << std::endl;
+  std::cout << "total reward: " << total_reward << std::endl;
+  std::cout << "observation hash: " << std::hex << hash.get() << std::dec << std::endl;
+  std::cout << "seconds stepping: " << stepping.count() << std::endl;
+  std::cout << "environment steps per second: " << count * steps / stepping.count() << std::endl;
+  return EXIT_SUCCESS;
+}